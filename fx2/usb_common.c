@@ -60,6 +60,7 @@ static void isr_SUDAV (void) interrupt
 static void isr_USBRESET (void) interrupt
 {
     clear_usb_irq ();
+    _usb_alt_setting = 0;
     setup_descriptors ();
 }
 
@@ -113,6 +114,28 @@ xdata volatile unsigned char * epcs (unsigned char ep)
     return EP2CS + (ep >> 1);    // 2, 4, 6, 8 are consecutive
 }
 
+// Look up interface ifc in the current configuration. Returns whether it
+// has alternate setting alt. With reset set, also resets the data toggles
+// of the endpoints in all its alternate settings, as SET_INTERFACE must.
+static unsigned char walk_interface (unsigned char ifc, unsigned char alt,
+                                     unsigned char reset)
+{
+    xdata unsigned char *p = current_config_descr;
+    xdata unsigned char *end = p + (p[2] | (p[3] << 8));
+    unsigned char found = 0, mine = 0;
+
+    for (; p < end && p[0] != 0; p += p[0]) {
+        if (p[1] == DT_INTERFACE) {
+            mine = (p[2] == ifc);
+            if (mine && p[3] == alt)
+                found = 1;
+        } else if (p[1] == DT_ENDPOINT && mine && reset)
+            fx2_reset_data_toggle (p[2]);
+    }
+
+    return found;
+}
+
 void usb_handle_setup_packet (void)
 {
     _usb_got_SUDAV = 0;
@@ -143,7 +166,7 @@ void usb_handle_setup_packet (void)
                         break;
                 // --------------------------------
                     case RQ_GET_INTERFACE:
-                        EP0BUF[0] = _usb_alt_setting;
+                        EP0BUF[0] = (wIndexL == 0) ? _usb_alt_setting : 0;
                         EP0BCH = 0;
                         EP0BCL = 1;
                         break;
@@ -240,7 +263,15 @@ void usb_handle_setup_packet (void)
                         _usb_config = wValueL;
                         break;
                     case RQ_SET_INTERFACE:
-                        _usb_alt_setting = wValueL;
+                        // only interface 0 has alternate settings, and
+                        // only at high speed
+                        if (!walk_interface (wIndexL, wValueL, 0))
+                            fx2_stall_ep0 ();
+                        else {
+                            walk_interface (wIndexL, wValueL, 1);
+                            if (wIndexL == 0)
+                                _usb_alt_setting = wValueL;
+                        }
                         break;
                 // --------------------------------
                     case RQ_CLEAR_FEATURE:
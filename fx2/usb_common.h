@@ -14,6 +14,7 @@
 #define LSB(x)	(((unsigned short) x) & 0xff)
 
 extern volatile __bit _usb_got_SUDAV;
+extern unsigned char _usb_alt_setting; // of interface 0
 
 // Provided by user application to report device status.
 // returns non-zero if it handled the command.
@@ -0,0 +1,336 @@
+/*
+ * gpifwave: compile GPIF waveform descriptions into wavedata tables
+ *
+ * Usage: gpifwave [-n name] [-t Dn] [-c MHz] input.gpf > output.h
+ *
+ * The input has one block per waveform, in the order they're loaded
+ * to 0xE400. A block starts with a line holding its name and a colon,
+ * followed by lines for the states, in the notation used in comments
+ * here before:
+ *
+ *   Single Write:
+ *   s0: BITS=D0     NEXT/SGLCRC DATA WAIT 4
+ *   s4: BITS=D1     DATA DP IF(RDY0) THEN 5 ELSE 2
+ *   s7: BITS=D1     DATA FIN
+ *
+ * BITS=   CTL outputs set in this state, D0..D5 joined with |
+ * WAIT n  stay n (1..256) IFCLK cycles, this is the default with n=1
+ * DP      decision point, IF(a [AND|OR|XOR b]) THEN x ELSE y;
+ *         a and b are RDY0..RDY5, TCXPIRE, FIFOFLAG or INTRDY
+ * DATA, NEXT/SGLCRC, INCAD, GINT  opcode bits
+ * FIN     the idle state s7
+ *
+ * Text after '#' is ignored. Each waveform takes 32 bytes in the layout
+ * of the waveform descriptor memory: 8 LENGTH/BRANCH, 8 OPCODE, 8 OUTPUT
+ * and 8 LOGIC FUNCTION bytes. The table is written to stdout, with the
+ * descriptions as comments. For each waveform, the cycles from trigger to
+ * idle are reported on stderr, following THEN at decision points, and the
+ * resulting TCK frequency if it's driven by a CTL output (option -t). The
+ * TCK rising edges are counted for both idle levels of that output,
+ * including the edge back to the idle level at the end.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define MAX_WAVES  4
+#define MAX_LINE   256
+
+/* Opcode bits */
+#define OP_DP      0x01
+#define OP_DATA    0x02
+#define OP_NEXT    0x04
+#define OP_INCAD   0x08
+#define OP_GINT    0x10
+
+struct wave {
+	char name[MAX_LINE];
+	char text[8][MAX_LINE];     /* state descriptions for the comment */
+	unsigned char length[8];
+	unsigned char opcode[8];
+	unsigned char output[8];
+	unsigned char logic[8];
+};
+
+static struct wave waves[MAX_WAVES];
+static int nwaves;
+
+static const char *filename;
+static int lineno;
+
+static void fail(const char *msg, const char *arg)
+{
+	fprintf(stderr, "%s:%d: %s%s\n", filename, lineno, msg, arg ? arg : "");
+	exit(1);
+}
+
+static int term(const char *s)
+{
+	static const char *names[] = {
+		"RDY0", "RDY1", "RDY2", "RDY3", "RDY4", "RDY5", "FIFOFLAG", "INTRDY"
+	};
+	int i;
+
+	if(strcmp(s, "TCXPIRE") == 0) return 5;
+	for(i = 0; i < 8; i++) if(strcmp(s, names[i]) == 0) return i;
+	fail("unknown term ", s);
+	return 0;
+}
+
+/* Parse the condition of IF(...) into a LOGIC FUNCTION byte */
+static unsigned char condition(char *s)
+{
+	char a[32], op[8], b[32];
+	int n = sscanf(s, "%31s %7s %31s", a, op, b);
+	int f;
+
+	if(n == 1) return (term(a) << 3) | term(a);
+	if(n != 3) fail("bad condition ", s);
+
+	if(strcmp(op, "AND") == 0) f = 0;
+	else if(strcmp(op, "OR") == 0) f = 1;
+	else if(strcmp(op, "XOR") == 0) f = 2;
+	else { fail("bad operator ", op); f = 0; }
+
+	if(a[0] == '!') {
+		if(f != 0) fail("negation only with AND: ", s);
+		return 0xC0 | (term(a+1) << 3) | term(b);
+	}
+	return (f << 6) | (term(a) << 3) | term(b);
+}
+
+static int number(const char *s, int min, int max)
+{
+	char *end;
+	long v = strtol(s, &end, 0);
+
+	if(*s == 0 || *end != 0 || v < min || v > max) fail("bad number ", s);
+	return (int)v;
+}
+
+static void state(struct wave *w, char *line)
+{
+	char *p = line, *tok, *toks[16];
+	char *cond = NULL, cbuf[MAX_LINE];
+	int s, i, ntok, wait = 1, then = -1, other = -1, dp = 0;
+
+	while(isspace((unsigned char)*p)) p++;
+	if(p[0] != 's' || !isdigit((unsigned char)p[1]) || p[2] != ':') fail("bad state ", p);
+	s = p[1] - '0';
+	if(s > 7) fail("no such state ", p);
+	if(w->text[s][0]) fail("state defined twice: ", p);
+	strcpy(w->text[s], p);
+
+	/* Cut out the condition first, it may contain spaces */
+	if((tok = strstr(p, "IF(")) != NULL) {
+		char *end = strchr(tok, ')');
+		if(end == NULL) fail("missing ) in ", p);
+		*end = 0;
+		strcpy(cbuf, tok + 3);
+		cond = cbuf;
+		memmove(tok, end + 1, strlen(end + 1) + 1);
+		dp = 1;
+	}
+
+	ntok = 0;
+	for(tok = strtok(p + 3, " \t"); tok != NULL; tok = strtok(NULL, " \t"))
+		if(ntok < 16) toks[ntok++] = tok;
+
+	for(i = 0; i < ntok; i++) {
+		tok = toks[i];
+		if(strncmp(tok, "BITS=", 5) == 0) {
+			char *b = tok + 5;
+			while(*b) {
+				if(b[0] != 'D' || b[1] < '0' || b[1] > '5' || (b[2] && b[2] != '|')) fail("bad output ", tok);
+				w->output[s] |= 1 << (b[1] - '0');
+				b += b[2] ? 3 : 2;
+			}
+		}
+		else if(strcmp(tok, "DATA") == 0) w->opcode[s] |= OP_DATA;
+		else if(strcmp(tok, "NEXT/SGLCRC") == 0 || strcmp(tok, "NEXT") == 0) w->opcode[s] |= OP_NEXT;
+		else if(strcmp(tok, "INCAD") == 0) w->opcode[s] |= OP_INCAD;
+		else if(strcmp(tok, "GINT") == 0) w->opcode[s] |= OP_GINT;
+		else if(strcmp(tok, "DP") == 0) dp = 1;
+		else if(strcmp(tok, "FIN") == 0) { if(s != 7) fail("FIN only in s7: ", w->text[s]); }
+		else if(i + 1 < ntok && strcmp(tok, "WAIT") == 0) wait = number(toks[++i], 1, 256);
+		else if(i + 1 < ntok && strcmp(tok, "THEN") == 0) then = number(toks[++i], 0, 7);
+		else if(i + 1 < ntok && strcmp(tok, "ELSE") == 0) other = number(toks[++i], 0, 7);
+		else fail("bad keyword ", tok);
+	}
+
+	if(s == 7) {
+		/* The idle state, its length and logic bytes are fixed */
+		w->length[7] = 7;
+		return;
+	}
+
+	if(dp) {
+		if(cond == NULL || then < 0 || other < 0) fail("incomplete decision point: ", w->text[s]);
+		w->opcode[s] |= OP_DP;
+		w->length[s] = (then << 3) | other;
+		w->logic[s] = condition(cond);
+	} else {
+		if(cond != NULL || then >= 0 || other >= 0) fail("IF without DP: ", w->text[s]);
+		w->length[s] = wait & 0xFF;
+	}
+}
+
+static void parse(FILE *f)
+{
+	char line[MAX_LINE];
+	struct wave *w = NULL;
+
+	while(fgets(line, sizeof line, f) != NULL) {
+		char *p, *c;
+
+		lineno++;
+		if((c = strchr(line, '#')) != NULL) *c = 0;
+		for(c = line + strlen(line); c > line && isspace((unsigned char)c[-1]); c--) *c = 0;
+		*c = 0;
+		for(p = line; isspace((unsigned char)*p); p++);
+		if(*p == 0) continue;
+
+		if(p[0] == 's' && isdigit((unsigned char)p[1]) && p[2] == ':') {
+			if(w == NULL) fail("state outside of a waveform", NULL);
+			state(w, p);
+		} else if(p[strlen(p)-1] == ':') {
+			if(nwaves == MAX_WAVES) fail("too many waveforms", NULL);
+			w = &waves[nwaves++];
+			memset(w, 0, sizeof *w);
+			strcpy(w->name, p);
+			w->length[7] = 7;
+		} else fail("syntax error: ", p);
+	}
+
+	if(nwaves == 0) fail("no waveforms", NULL);
+}
+
+/* Follow the waveform from s0 to the idle state, taking THEN at decision
+ * points. Returns the number of IFCLK cycles, counts rising edges on CTL
+ * output tck (if >= 0) in *edges. The output starts at the idle level
+ * and returns there in s7, which can add an edge at either end. */
+static long cycles(const struct wave *w, int tck, int idle, int *edges)
+{
+	long n = 0;
+	int s = 0, steps = 0, level = idle;
+
+	*edges = 0;
+	while(s != 7) {
+		if(++steps > 64) return -1; /* loops */
+		if(tck >= 0) {
+			int l = (w->output[s] >> tck) & 1;
+			if(l && !level) (*edges)++;
+			level = l;
+		}
+		if(w->opcode[s] & OP_DP) {
+			n += 1;
+			s = (w->length[s] >> 3) & 7;
+		} else {
+			n += w->length[s] ? w->length[s] : 256;
+			s++;
+		}
+	}
+	if(tck >= 0 && idle && !level) (*edges)++;
+	return n;
+}
+
+static void report(double mhz, int tck)
+{
+	int i, edges, high;
+
+	for(i = 0; i < nwaves; i++) {
+		long n = cycles(&waves[i], tck, 0, &edges);
+
+		cycles(&waves[i], tck, 1, &high);
+
+		if(n < 0) {
+			fprintf(stderr, "%s doesn't reach idle, following THEN\n", waves[i].name);
+			continue;
+		}
+		fprintf(stderr, "%s %ld cycles, %.1f ns", waves[i].name, n, n * 1000.0 / mhz);
+		if(tck >= 0) {
+			if(edges > 0)
+				fprintf(stderr, ", %d TCK pulse(s), max. %.2f MHz TCK", edges, edges * mhz / n);
+			else
+				fprintf(stderr, ", no TCK pulse");
+			if(high != edges)
+				fprintf(stderr, "; %d rising edge(s) from idle high", high);
+		}
+		fprintf(stderr, "\n");
+	}
+}
+
+static void row(const unsigned char *b, int last)
+{
+	int i;
+
+	printf("\t");
+	for(i = 0; i < 8; i++) {
+		if(b[i] < 10) printf("%d", b[i]); else printf("0x%02X", b[i]);
+		if(i < 7) printf(", "); else if(!last) printf(",");
+	}
+	printf("\n");
+}
+
+static void table(const char *name)
+{
+	int i, j;
+
+	printf("/* Generated by gpifwave from %s, don't edit */\n\n", filename);
+	printf("const unsigned char %s[%d] =\n{\n", name, nwaves * 32);
+
+	for(i = 0; i < nwaves; i++) {
+		struct wave *w = &waves[i];
+
+		w->logic[7] = 0x3F;
+
+		printf("\t/* %s", w->name);
+		for(j = 0; j < 8; j++) if(w->text[j][0]) printf("\n\t   %s", w->text[j]);
+		printf(" */\n\n");
+
+		row(w->length, 0);
+		row(w->opcode, 0);
+		row(w->output, 0);
+		row(w->logic, i == nwaves - 1);
+		if(i < nwaves - 1) printf("\n");
+	}
+
+	printf("};\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = "wavedata";
+	double mhz = 48.0;
+	int tck = -1;
+	FILE *f;
+	int i;
+
+	for(i = 1; i < argc - 1; i++) {
+		if(strcmp(argv[i], "-n") == 0 && i + 1 < argc - 1) name = argv[++i];
+		else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc - 1) mhz = atof(argv[++i]);
+		else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc - 1
+				&& argv[i+1][0] == 'D' && argv[i+1][1] >= '0' && argv[i+1][1] <= '5')
+			tck = argv[++i][1] - '0';
+		else break;
+	}
+	if(i != argc - 1 || mhz <= 0) {
+		fprintf(stderr, "usage: %s [-n name] [-t Dn] [-c MHz] input.gpf\n", argv[0]);
+		return 1;
+	}
+
+	filename = argv[i];
+	if((f = fopen(filename, "r")) == NULL) {
+		perror(filename);
+		return 1;
+	}
+	parse(f);
+	fclose(f);
+
+	table(name);
+	report(mhz, tck);
+
+	return 0;
+}
@@ -6,6 +6,27 @@ extern void ProgIO_Set_State(unsigned char d);
 extern unsigned char ProgIO_Set_Get_State(unsigned char d);
 extern void ProgIO_ShiftOut(unsigned char x);
 extern unsigned char ProgIO_ShiftInOut(unsigned char x);
+extern void ProgIO_ShiftTMS(unsigned char tms, unsigned char n);
+extern void ProgIO_Clock(unsigned long n);
+
+/* Shift N (1..256, 0 means 256) bytes read through XAUTODAT1,
+ * ShiftInOut_Block writes the TDO bytes through XAUTODAT2 */
+extern void ProgIO_ShiftOut_Block(unsigned char n);
+extern void ProgIO_ShiftInOut_Block(unsigned char n);
+
+/* Select the TCK speed, 0 is the fastest, higher values are slower.
+ * Returns the speed actually set, backends without control return 0. */
+extern unsigned char ProgIO_SetSpeed(unsigned char s);
+
+/* Switch adaptive clocking (TCK waits for RTCK) on or off. Returns bit 0
+ * set if it's on, bit 1 if RTCK didn't follow TCK in time since the last
+ * call. Backends without RTCK return 0. */
+extern unsigned char ProgIO_SetAdaptive(unsigned char on);
+
+/* Select where the fast kernels sample TDO: 0 before the rising edge of
+ * TCK, 1 while TCK is high, 2 after the falling edge. Returns the delay
+ * set, backends without a choice return 0. */
+extern unsigned char ProgIO_SetSampleDelay(unsigned char d);
 
 #endif
 
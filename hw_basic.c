@@ -6,6 +6,11 @@
 #define HAVE_PS_MODE 1
 #define HAVE_AS_MODE 1
 
+/* Write-only byte shifts through USART0 in mode 0 (12 MHz shift clock).
+ * Needs a board with TCK = PC.2 OR NOT TXD0 and TDI = PC.0 AND RXD0.
+ * Both USART pins idle high, so bit banging on Port C works as usual. */
+//#define HAVE_USART_SHIFT 1
+
 //-----------------------------------------------------------------------------
 /* JTAG TCK, AS/PS DCLK */
 
@@ -35,6 +40,15 @@ sbit at 0xA1          TDO; /* Port C.1 */
 sbit JTAG_EN = 0xA7; /* Port C.7 */
 #define bmJTAG_EN bmBIT7
 
+/* JTAG RTCK, the TCK returned by targets with adaptive clocking */
+
+sbit at 0x83          RTCK; /* Port A.3 */
+#define bmRTCKOE      bmBIT3
+
+/* Where the kernels with a TDO sample delay put the sample */
+
+sbit at 0xE7          ACC_TDO; /* ACC.7 */
+
 //-----------------------------------------------------------------------------
 
 #if defined(HAVE_PS_MODE) || defined(HAVE_AS_MODE)
@@ -76,7 +90,7 @@ sbit JTAG_EN = 0xA7; /* Port C.7 */
   #define bmNCEOE     0
   #define SetNCE(x)   while(0){}
 
-  #define ProgIO_ShiftInOut_AS(x) ProgIO_ShiftInOut(x)
+  #define ProgIO_ShiftInOut_AS(x) ProgIO_ShiftInOut_JTAG(x)
 
 #endif
 
@@ -85,6 +99,23 @@ sbit JTAG_EN = 0xA7; /* Port C.7 */
 #define bmPROGOUTOE (bmTCKOE|bmTDIOE|bmTMSOE|bmNCEOE|bmNCSOE)
 #define bmPROGINOE  (bmTDOOE|bmASDOOE)
 
+/* TCK speed, see ProgIO_SetSpeed */
+static unsigned char tck_speed;
+static unsigned char tck_delay; /* DJNZ loops per TCK half period */
+
+/* Adaptive clocking, see ProgIO_SetAdaptive */
+static __bit rtck_on;       /* each TCK edge waits for RTCK to follow */
+static __bit rtck_timeout;  /* RTCK didn't follow in time */
+
+#define RTCK_POLLS    1024 /* about 0.6 ms */
+
+/* TDO sample point of the fast kernels, see ProgIO_SetSampleDelay */
+static unsigned char tdo_delay;
+
+#define TckFast()     (tck_speed == 0 && !rtck_on)
+
+static void WaitRTCK(unsigned char level);
+
 //-----------------------------------------------------------------------------
 void ProgIO_Init(void)
 {
@@ -102,6 +133,22 @@ void ProgIO_Init(void)
 
 	// activate JTAG outputs on Port C
 	OEC = bmTDIOE | bmTCKOE | bmTMSOE | bmJTAG_EN;
+
+	tck_speed = 0;
+	tck_delay = 0;
+
+	// RTCK is an input
+	OEA &= ~bmRTCKOE;
+	rtck_on = 0;
+	rtck_timeout = 0;
+
+	tdo_delay = 0;
+
+#ifdef HAVE_USART_SHIFT
+	// USART0 mode 0 with CLKOUT/4, no receiver. TI is kept set while idle.
+	SCON0 = 0x20;
+	TI = 1;
+#endif
 }
 
 void ProgIO_Set_State(unsigned char d)
@@ -123,6 +170,8 @@ void ProgIO_Set_State(unsigned char d)
 	SetNCS((d & bmBIT3) ? 1 : 0);
 #endif
 	SetTDI((d & bmBIT4) ? 1 : 0);
+
+	if(rtck_on) WaitRTCK(d & bmBIT0);
 }
 
 unsigned char ProgIO_Set_Get_State(unsigned char d)
@@ -138,7 +187,44 @@ unsigned char ProgIO_Set_Get_State(unsigned char d)
 }
 
 //-----------------------------------------------------------------------------
-void ProgIO_ShiftOut(unsigned char c)
+#ifdef HAVE_USART_SHIFT
+
+void ProgIO_ShiftOut_Fast(unsigned char c)
+{
+	/* Shift out byte C through USART0: it shifts LSB first, like JTAG.
+	 * TDI follows RXD0 while PC.0 is high. NOT TXD0 rises in the middle
+	 * of each bit, TDI changes when it falls. Afterwards, TDI is left at
+	 * the last bit, as in the bit banging version. */
+
+	SetTDI(1);
+	while(!TI);
+	TI = 0;
+	SBUF0 = c;
+	while(!TI);
+	SetTDI((c & 0x80) ? 1 : 0);
+}
+
+void ProgIO_ShiftOut_Block_Fast(unsigned char n)
+{
+	/* Shift out N (1..256, 0 means 256) bytes read through XAUTODAT1
+	 * through USART0, see ProgIO_ShiftOut_Fast */
+
+	unsigned char c;
+
+	SetTDI(1);
+	do {
+		c = XAUTODAT1;
+		while(!TI);
+		TI = 0;
+		SBUF0 = c;
+	} while(--n);
+	while(!TI);
+	SetTDI((c & 0x80) ? 1 : 0);
+}
+
+#else /* HAVE_USART_SHIFT */
+
+void ProgIO_ShiftOut_Fast(unsigned char c)
 {
 	/* Shift out byte C:
 	 *
@@ -199,29 +285,142 @@ void ProgIO_ShiftOut(unsigned char c)
 	__endasm;
 }
 
-/*
-;; For ShiftInOut, the timing is a little more
-;; critical because we have to read _TDO/shift/set _TDI
-;; when _TCK is low. But 20% duty cycle at 48/4/5 MHz
-;; is just like 50% at 6 Mhz, and that's still acceptable
-*/
+void ProgIO_ShiftOut_Block_Fast(unsigned char n)
+{
+	/* Shift out N (1..256, 0 means 256) bytes read through XAUTODAT1,
+	 * each like in ProgIO_ShiftOut_Fast. TCK stays high from the last bit of
+	 * one byte until the first bit of the next one is put out. */
+
+	(void)n; /* argument passed in DPL */
 
-#if HAVE_AS_MODE
+	__asm
+        MOV  R7,DPL
+        MOV  DPTR,#0xE67B ;; XAUTODAT1
+00001$:
+        MOVX A,@DPTR
+        ;; Bit0
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit1
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit2
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit3
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit4
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit5
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit6
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit7
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        DJNZ R7,00001$
+        nop
+        CLR  _TCK
+        ret
+	__endasm;
+}
 
-unsigned char ProgIO_ShiftInOut_JTAG(unsigned char c);
-unsigned char ProgIO_ShiftInOut_AS(unsigned char c);
+#endif /* HAVE_USART_SHIFT */
 
-unsigned char ProgIO_ShiftInOut(unsigned char c)
+void ProgIO_ShiftTMS_Fast(unsigned char tms, unsigned char n)
 {
-	if(GetNCS(x)) return ProgIO_ShiftInOut_JTAG(c);
-	return ProgIO_ShiftInOut_AS(c);
+	/* Clock out N (1..8) bits from TMS, TDI is left unchanged:
+	 *
+	 * N times {
+	 *   Output least significant bit on TMS
+	 *   Raise TCK
+	 *   Shift tms right
+	 *   Lower TCK
+	 * }
+	 */
+
+	(void)tms; /* argument passed in DPL */
+	(void)n;   /* argument passed in _ProgIO_ShiftTMS_Fast_PARM_2 */
+
+	__asm
+        MOV  A,DPL
+        MOV  R7,_ProgIO_ShiftTMS_Fast_PARM_2
+00001$:
+        RRC  A
+        MOV  _TMS,C
+        SETB _TCK
+        nop
+        CLR  _TCK
+        DJNZ R7,00001$
+        ret
+	__endasm;
 }
 
-#else /* HAVE_AS_MODE */
+void ProgIO_Clock_Fast(unsigned long n)
+{
+	/* Run N (1..2^24) TCK cycles, TMS and TDI are left unchanged.
+	 *
+	 * N is passed in B:DPH:DPL. The loop counts down with three nested
+	 * DJNZ, which count 256 for zero. Adjust the upper bytes for that:
+	 * if the low byte isn't zero, increment the upper 16 bits, and if
+	 * the middle byte then isn't zero, increment the high byte.
+	 */
 
-#define ProgIO_ShiftInOut_JTAG(x) ProgIO_ShiftInOut(x)
+	(void)n;
 
-#endif
+	__asm
+        MOV  R7,DPL
+        MOV  R6,DPH
+        MOV  R5,B
+        MOV  A,R7
+        JZ   00001$
+        MOV  A,R6
+        ADD  A,#1
+        MOV  R6,A
+        MOV  A,R5
+        ADDC A,#0
+        MOV  R5,A
+00001$:
+        MOV  A,R6
+        JZ   00002$
+        INC  R5
+00002$:
+        SETB _TCK
+        nop
+        CLR  _TCK
+        DJNZ R7,00002$
+        DJNZ R6,00002$
+        DJNZ R5,00002$
+        ret
+	__endasm;
+}
+
+/*
+;; For ShiftInOut, the timing is a little more
+;; critical because we have to read _TDO/shift/set _TDI
+;; when _TCK is low. But 20% duty cycle at 48/4/5 MHz
+;; is just like 50% at 6 Mhz, and that's still acceptable
+*/
 
 unsigned char ProgIO_ShiftInOut_JTAG(unsigned char c)
 {
@@ -299,6 +498,76 @@ unsigned char ProgIO_ShiftInOut_JTAG(unsigned char c)
 	return c;
 }
 
+void ProgIO_ShiftInOut_Block_JTAG(unsigned char n)
+{
+	/* Shift N (1..256, 0 means 256) bytes read through XAUTODAT1, each
+	 * like in ProgIO_ShiftInOut_JTAG, and write the results through
+	 * XAUTODAT2 */
+
+	(void)n; /* argument passed in DPL */
+
+	__asm
+        MOV  R7,DPL
+00001$:
+        MOV  DPTR,#0xE67B ;; XAUTODAT1
+        MOVX A,@DPTR
+
+        ;; Bit0
+        MOV  C,_TDO
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        ;; Bit1
+        MOV  C,_TDO
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        ;; Bit2
+        MOV  C,_TDO
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        ;; Bit3
+        MOV  C,_TDO
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        ;; Bit4
+        MOV  C,_TDO
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        ;; Bit5
+        MOV  C,_TDO
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        ;; Bit6
+        MOV  C,_TDO
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        ;; Bit7
+        MOV  C,_TDO
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+
+        MOV  DPTR,#0xE67C ;; XAUTODAT2
+        MOVX @DPTR,A
+        DJNZ R7,00001$
+        ret
+	__endasm;
+}
+
 #ifdef HAVE_AS_MODE
 
 unsigned char ProgIO_ShiftInOut_AS(unsigned char c)
@@ -376,3 +645,441 @@ unsigned char ProgIO_ShiftInOut_AS(unsigned char c)
 }
 
 #endif
+
+//-----------------------------------------------------------------------------
+/* TCK speed control. The kernels above run as fast as the CPU can toggle
+ * the pins (at 12 MIPS, about 1.7 MHz TCK for writes and 1.3 MHz for reads,
+ * 12 MHz for writes through USART0), with a short high phase. The speed
+ * set by ProgIO_SetSpeed selects these or slower kernels with a 50% duty
+ * cycle:
+ *
+ *   0       the fast kernels (default)
+ *   1       ProgIO_ShiftInOut_Padded, 14 cycles per bit, about 857 kHz
+ *   2..255  ProgIO_ShiftInOut_Slow, 24+6*(speed-1) cycles per bit,
+ *           that's 2 MHz/(speed+3): 400 kHz down to 7.8 kHz
+ *
+ * Write-only shifts use the read kernels at speeds above 0, the result is
+ * dropped. TMS shifts and idle clocks run in C loops with TckDelay.
+ *
+ * With adaptive clocking enabled, the speed is ignored. Each TCK edge then
+ * waits until RTCK follows, so the clock adapts to targets which
+ * synchronize TCK to a (maybe gated or slowed down) core clock. A target
+ * that doesn't answer within RTCK_POLLS makes the edge go on anyway and
+ * sets rtck_timeout for the host.
+ */
+
+unsigned char ProgIO_SetSpeed(unsigned char s)
+{
+	tck_speed = s;
+	tck_delay = s ? s - 1 : 0;
+	return s;
+}
+
+static void TckDelay(void)
+{
+	/* Wait tck_delay DJNZ loops, none if it's zero */
+
+	__asm
+        MOV  A,_tck_delay
+        JZ   00002$
+        MOV  R7,A
+00001$:
+        DJNZ R7,00001$
+00002$:
+        ret
+	__endasm;
+}
+
+unsigned char ProgIO_ShiftInOut_Padded(unsigned char c)
+{
+	/* Like ProgIO_ShiftInOut_JTAG, but with NOPs to make both TCK phases
+	 * 7 cycles long. TCK is lowered at the top of the loop, which doesn't
+	 * change it for the first bit. */
+
+	(void)c; /* argument passed in DPL */
+
+	__asm
+        MOV  A,DPL
+        MOV  R7,#8
+00001$:
+        CLR  _TCK
+        MOV  C,_TDO
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        nop
+        nop
+        DJNZ R7,00001$
+        CLR  _TCK
+
+        MOV  DPL,A
+        ret
+	__endasm;
+
+	/* return value in DPL */
+	return c;
+}
+
+unsigned char ProgIO_SetAdaptive(unsigned char on)
+{
+	/* Returns bit 0 set if adaptive clocking is on, bit 1 if RTCK timed
+	 * out since the last call */
+
+	unsigned char r = rtck_timeout ? 2 : 0;
+
+	rtck_timeout = 0;
+	rtck_on = on ? 1 : 0;
+	return r | (on ? 1 : 0);
+}
+
+static void WaitRTCK(unsigned char level)
+{
+	unsigned int n = RTCK_POLLS;
+
+	while(RTCK != (level ? 1 : 0)) {
+		if(--n == 0) {
+			rtck_timeout = 1;
+			return;
+		}
+	}
+}
+
+unsigned char ProgIO_ShiftInOut_Slow(unsigned char c)
+{
+	/* Like ProgIO_ShiftInOut_JTAG, with a delay loop of tck_delay (1..254)
+	 * in the low phase and tck_delay+2 in the high phase, which makes up
+	 * for the instructions in the low phase. TDO is sampled after the
+	 * delay, at the end of the low phase. */
+
+	(void)c; /* argument passed in DPL */
+
+	__asm
+        MOV  A,DPL
+        MOV  R7,#8
+00001$:
+        MOV  R6,_tck_delay
+00002$:
+        DJNZ R6,00002$
+        MOV  C,_TDO
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        MOV  R6,_tck_delay
+        INC  R6
+        INC  R6
+00003$:
+        DJNZ R6,00003$
+        CLR  _TCK
+        DJNZ R7,00001$
+
+        MOV  DPL,A
+        ret
+	__endasm;
+
+	/* return value in DPL */
+	return c;
+}
+
+unsigned char ProgIO_ShiftInOut_RTCK(unsigned char c)
+{
+	/* Like ProgIO_ShiftInOut_JTAG, but after each edge of TCK, wait for
+	 * RTCK to follow, giving up after 4*256 polls (s.a.). TDO is sampled
+	 * after RTCK went low, the target has updated it by then. */
+
+	(void)c; /* argument passed in DPL */
+
+	__asm
+        MOV  A,DPL
+        MOV  R7,#8
+00001$:
+        MOV  C,_TDO
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        MOV  R5,#4
+        MOV  R6,#0
+00002$:
+        JB   _RTCK,00003$
+        DJNZ R6,00002$
+        DJNZ R5,00002$
+        SETB _rtck_timeout
+00003$:
+        CLR  _TCK
+        MOV  R5,#4
+        MOV  R6,#0
+00004$:
+        JNB  _RTCK,00005$
+        DJNZ R6,00004$
+        DJNZ R5,00004$
+        SETB _rtck_timeout
+00005$:
+        DJNZ R7,00001$
+
+        MOV  DPL,A
+        ret
+	__endasm;
+
+	/* return value in DPL */
+	return c;
+}
+
+//-----------------------------------------------------------------------------
+/* TDO sample delay. The fast kernels read TDO right before they raise TCK,
+ * 2 cycles after the previous falling edge. Through long cables and level
+ * shifters, TDO may not have settled by then. Later sample points:
+ *
+ *   0  before the rising edge (default)
+ *   1  in the high phase, 9 cycles after the previous falling edge
+ *   2  after the falling edge, 13 cycles after the previous one. The
+ *      round trip to the target must be at least 2 cycles then.
+ *
+ * Both later ones take 11 cycles per bit instead of 9. The slower kernels
+ * sample at the end of their low phase anyway.
+ */
+
+unsigned char ProgIO_SetSampleDelay(unsigned char d)
+{
+	tdo_delay = (d > 2) ? 2 : d;
+	return tdo_delay;
+}
+
+unsigned char ProgIO_ShiftInOut_Late(unsigned char c)
+{
+	/* Like ProgIO_ShiftInOut_JTAG, but TDO is sampled while TCK is high,
+	 * right before the falling edge, and goes to ACC.7 after RRC */
+
+	(void)c; /* argument passed in DPL */
+
+	__asm
+        MOV  A,DPL
+
+        ;; Bit0
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        MOV  C,_TDO
+        CLR  _TCK
+        MOV  _ACC_TDO,C
+        ;; Bit1
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        MOV  C,_TDO
+        CLR  _TCK
+        MOV  _ACC_TDO,C
+        ;; Bit2
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        MOV  C,_TDO
+        CLR  _TCK
+        MOV  _ACC_TDO,C
+        ;; Bit3
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        MOV  C,_TDO
+        CLR  _TCK
+        MOV  _ACC_TDO,C
+        ;; Bit4
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        MOV  C,_TDO
+        CLR  _TCK
+        MOV  _ACC_TDO,C
+        ;; Bit5
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        MOV  C,_TDO
+        CLR  _TCK
+        MOV  _ACC_TDO,C
+        ;; Bit6
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        MOV  C,_TDO
+        CLR  _TCK
+        MOV  _ACC_TDO,C
+        ;; Bit7
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        MOV  C,_TDO
+        CLR  _TCK
+        MOV  _ACC_TDO,C
+
+        MOV  DPL,A
+        ret
+	__endasm;
+
+	/* return value in DPL */
+	return c;
+}
+
+unsigned char ProgIO_ShiftInOut_Fall(unsigned char c)
+{
+	/* Like ProgIO_ShiftInOut_Late, but TDO is sampled after the falling
+	 * edge */
+
+	(void)c; /* argument passed in DPL */
+
+	__asm
+        MOV  A,DPL
+
+        ;; Bit0
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        MOV  C,_TDO
+        MOV  _ACC_TDO,C
+        ;; Bit1
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        MOV  C,_TDO
+        MOV  _ACC_TDO,C
+        ;; Bit2
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        MOV  C,_TDO
+        MOV  _ACC_TDO,C
+        ;; Bit3
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        MOV  C,_TDO
+        MOV  _ACC_TDO,C
+        ;; Bit4
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        MOV  C,_TDO
+        MOV  _ACC_TDO,C
+        ;; Bit5
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        MOV  C,_TDO
+        MOV  _ACC_TDO,C
+        ;; Bit6
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        MOV  C,_TDO
+        MOV  _ACC_TDO,C
+        ;; Bit7
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        MOV  C,_TDO
+        MOV  _ACC_TDO,C
+
+        MOV  DPL,A
+        ret
+	__endasm;
+
+	/* return value in DPL */
+	return c;
+}
+
+static unsigned char ShiftInOutTimed(unsigned char c)
+{
+	if(rtck_on) return ProgIO_ShiftInOut_RTCK(c);
+	if(tck_speed == 1) return ProgIO_ShiftInOut_Padded(c);
+	return ProgIO_ShiftInOut_Slow(c);
+}
+
+static void TckCycle(void)
+{
+	/* One TCK cycle for the C loops below */
+
+	if(rtck_on) {
+		SetTCK(1);
+		WaitRTCK(1);
+		SetTCK(0);
+		WaitRTCK(0);
+		return;
+	}
+
+	TckDelay();
+	SetTCK(1);
+	TckDelay();
+	SetTCK(0);
+}
+
+void ProgIO_ShiftOut(unsigned char c)
+{
+	if(TckFast()) ProgIO_ShiftOut_Fast(c);
+	else ShiftInOutTimed(c);
+}
+
+void ProgIO_ShiftOut_Block(unsigned char n)
+{
+	if(TckFast()) {
+		ProgIO_ShiftOut_Block_Fast(n);
+		return;
+	}
+
+	do {
+		ShiftInOutTimed(XAUTODAT1);
+	} while(--n);
+}
+
+void ProgIO_ShiftTMS(unsigned char tms, unsigned char n)
+{
+	if(TckFast()) {
+		ProgIO_ShiftTMS_Fast(tms, n);
+		return;
+	}
+
+	do {
+		SetTMS(tms & 1);
+		tms >>= 1;
+		TckCycle();
+	} while(--n);
+}
+
+void ProgIO_Clock(unsigned long n)
+{
+	if(TckFast()) {
+		ProgIO_Clock_Fast(n);
+		return;
+	}
+
+	do {
+		TckCycle();
+	} while(--n);
+}
+
+unsigned char ProgIO_ShiftInOut(unsigned char c)
+{
+	/* AS mode always runs at full speed */
+	if(!GetNCS(x)) return ProgIO_ShiftInOut_AS(c);
+	if(!TckFast()) return ShiftInOutTimed(c);
+	if(tdo_delay == 1) return ProgIO_ShiftInOut_Late(c);
+	if(tdo_delay == 2) return ProgIO_ShiftInOut_Fall(c);
+	return ProgIO_ShiftInOut_JTAG(c);
+}
+
+void ProgIO_ShiftInOut_Block(unsigned char n)
+{
+	if(GetNCS(x) && TckFast() && tdo_delay == 0) {
+		ProgIO_ShiftInOut_Block_JTAG(n);
+		return;
+	}
+
+	do {
+		XAUTODAT2 = ProgIO_ShiftInOut(XAUTODAT1);
+	} while(--n);
+}
@@ -0,0 +1,402 @@
+#include "fx2regs.h"
+#include "syncdelay.h"
+#include "hardware.h"
+#include "delay.h"
+
+/*
+ * GPIF assisted variant of hw_basic. The GPIF generates the TCK pulses and
+ * drives TDI from the data written to it, the 8051 only has to feed one byte
+ * per bit into GPIFSGLDATLX. This requires a slightly different wiring:
+ *
+ *   TCK  CTL0          (instead of PC.2)
+ *   TDI  FD0 = PB.0    (instead of PC.0)
+ *   TMS  PC.3
+ *   TDO  PC.1
+ *
+ * TMS and TDO stay on Port C and are handled by the CPU. Since the GPIF is
+ * the master of the FIFO interface, the EP6/EP8 slave FIFOs aren't usable.
+ * There's no AS/PS mode support.
+ *
+ * This is still CPU driven bit banging: every bit takes a write to
+ * GPIFSGLDATLX, and the CPU is busy for the whole shift. Writes reach about
+ * 4 MHz TCK (hw_basic 1.7 MHz). Reads reach about 1.2 MHz, no faster than
+ * the fast kernels of hw_basic (1.3 MHz), since TDO is read by the CPU.
+ * There's no FIFO fed path at tens of MHz: the GPIF can't serialize a byte,
+ * so it would need one FIFO byte per TCK cycle, built by the CPU from the
+ * Blaster byte stream at about the same cost. What it does give
+ * is TCK with fixed high and low times from the waveforms, independent of
+ * instruction timing, and TDI set up a whole state before the rising edge.
+ * Use it where that matters or for boards wired this way, hw_basic
+ * otherwise.
+ */
+
+//-----------------------------------------------------------------------------
+
+/* JTAG TMS */
+
+sbit at 0xA3          TMS; /* Port C.3 */
+#define bmTMSOE       bmBIT3
+#define SetTMS(x)     do{TMS=(x);}while(0)
+
+/* JTAG TDO */
+
+sbit at 0xA1          TDO; /* Port C.1 */
+#define GetTDO(x)     TDO
+
+/* JTAG ENABLE */
+sbit JTAG_EN = 0xA7; /* Port C.7 */
+#define bmJTAG_EN bmBIT7
+
+/* Waveforms, selected for single write transactions */
+
+#define WF_PULSE      0 /* TDI from data, one TCK pulse */
+#define WF_TCK_LOW    1 /* TDI from data, TCK low */
+#define WF_TCK_HIGH   2 /* TDI from data, TCK high */
+
+#define SelectWave(w) do{GPIFWFSELECT=((w)<<6);}while(0)
+#define WaitGPIF()    while(!(GPIFTRIG & 0x80))
+
+static unsigned char tdi; /* current state of TDI, 0 or 1 */
+static unsigned char tck; /* idle level of TCK, 0 or 1 */
+
+//-----------------------------------------------------------------------------
+
+/* Each waveform runs in less than 12 IFCLK cycles, which is the time the
+ * CPU takes for the shortest sequence between two triggers (MOV direct,A
+ * and RR A). So the shift kernels below don't have to check for DONE. */
+
+/* wavedata[], generated from hw_gpif.gpf by gpifwave */
+#include "hw_gpif_wave.h"
+
+/* The pulse returns to the idle level of TCK, so each kernel first takes
+ * it down if a bit banging byte left TCK high. Otherwise every pulse would
+ * end with a second rising edge. Called from the kernels below before they
+ * use DPTR or the data in DPL, keeps both; changes A. */
+static void TckIdleLow(void)
+{
+	__asm
+        MOV  A,_tck
+        JZ   00002$
+00001$:
+        MOV  A,_GPIFTRIG
+        RLC  A ;; DONE to C
+        JNC  00001$
+        PUSH DPL
+        PUSH DPH
+        MOV  DPTR,#0xE6C2 ;; GPIFIDLECTL
+        CLR  A
+        MOVX @DPTR,A
+        MOV  _tck,A
+        POP  DPH
+        POP  DPL
+00002$:
+        ret
+	__endasm;
+}
+
+//-----------------------------------------------------------------------------
+void ProgIO_Init(void)
+{
+	unsigned char i;
+
+	// set the CPU clock to 48MHz, enable clock output to FPGA
+	CPUCS = bmCLKOE | bmCLKSPD1;
+
+	// internal clock source at 48Mhz, drive output pin, GPIF master mode
+	IFCONFIG = bmIFCLKSRC | bm3048MHZ | bmIFCLKOE | bmIFGPIF;
+
+	// TMS and JTAG enable on Port C, TDO is an input
+	PORTCCFG = 0x00;
+	OEC = bmTMSOE | bmJTAG_EN;
+
+	GPIFABORT    = 0xFF;
+
+	GPIFREADYCFG = 0xA0;
+	GPIFCTLCFG   = 0x00; // CTL outputs are CMOS
+	GPIFIDLECS   = 0x01; // Keep driving TDI while idle
+	GPIFIDLECTL  = 0x00; // TCK low while idle
+
+	// Copy waveform data
+	AUTOPTRSETUP = 0x07;
+	APTR1H = MSB( &wavedata );
+	APTR1L = LSB( &wavedata );
+	AUTOPTRH2 = 0xE4;
+	AUTOPTRL2 = 0x00;
+	for ( i = 0; i < 96; i++ ) EXTAUTODAT2 = EXTAUTODAT1;
+
+	SYNCDELAY;
+	GPIFADRH      = 0x00;
+	SYNCDELAY;
+	GPIFADRL      = 0x00;
+
+	FLOWSTATE     = 0x00;
+	FLOWLOGIC     = 0x00;
+	FLOWEQ0CTL    = 0x00;
+	FLOWEQ1CTL    = 0x00;
+	FLOWHOLDOFF   = 0x00;
+	FLOWSTB       = 0x00;
+	FLOWSTBEDGE   = 0x00;
+	FLOWSTBHPERIOD = 0x00;
+
+	tdi = 0;
+	tck = 0;
+	SelectWave(WF_TCK_LOW);
+	GPIFSGLDATLX = tdi;
+	WaitGPIF();
+	SelectWave(WF_PULSE);
+}
+
+void ProgIO_Set_State(unsigned char d)
+{
+	/* Set state of output pins:
+	 *
+	 * d.0 => TCK
+	 * d.1 => TMS
+	 * d.4 => TDI
+	 * d.5 => LED / Output Enable
+	 *
+	 * The idle state of TCK is changed first, then TDI is set by a
+	 * transaction which holds TCK at the same level. TCK stays there
+	 * until the next call or shift.
+	 */
+
+	SetTMS((d & bmBIT1) ? 1 : 0);
+	tdi = (d & bmBIT4) ? 1 : 0;
+	tck = d & bmBIT0;
+
+	WaitGPIF();
+	GPIFIDLECTL = tck;
+	SelectWave((d & bmBIT0) ? WF_TCK_HIGH : WF_TCK_LOW);
+	GPIFSGLDATLX = tdi;
+	WaitGPIF();
+	SelectWave(WF_PULSE);
+}
+
+unsigned char ProgIO_Set_Get_State(unsigned char d)
+{
+	/* Set state of output pins (s.a.)
+	 * then read state of input pins:
+	 *
+	 * TDO => d.0
+	 */
+	ProgIO_Set_State(d);
+	return 2|GetTDO();
+}
+
+//-----------------------------------------------------------------------------
+void ProgIO_ShiftOut(unsigned char c)
+{
+	/* Shift out byte C:
+	 *
+	 * 8x {
+	 *   Trigger a pulse with c, the GPIF drives c.0 on TDI
+	 *   Rotate c right
+	 * }
+	 *
+	 * TDI keeps the last bit, bit 7.
+	 */
+
+	(void)c; /* argument passed in DPL */
+
+	__asm
+        LCALL _TckIdleLow
+        MOV  A,DPL
+        MOV  _GPIFSGLDATLX,A
+        RR   A
+        MOV  _GPIFSGLDATLX,A
+        RR   A
+        MOV  _GPIFSGLDATLX,A
+        RR   A
+        MOV  _GPIFSGLDATLX,A
+        RR   A
+        MOV  _GPIFSGLDATLX,A
+        RR   A
+        MOV  _GPIFSGLDATLX,A
+        RR   A
+        MOV  _GPIFSGLDATLX,A
+        RR   A
+        MOV  _GPIFSGLDATLX,A
+        ANL  A,#1
+        MOV  _tdi,A
+        ret
+	__endasm;
+}
+
+void ProgIO_ShiftOut_Block(unsigned char n)
+{
+	/* Shift out N (1..256, 0 means 256) bytes read through XAUTODAT1,
+	 * each like in ProgIO_ShiftOut */
+
+	(void)n; /* argument passed in DPL */
+
+	__asm
+        LCALL _TckIdleLow
+        MOV  R7,DPL
+        MOV  DPTR,#0xE67B ;; XAUTODAT1
+00001$:
+        MOVX A,@DPTR
+        MOV  _GPIFSGLDATLX,A
+        RR   A
+        MOV  _GPIFSGLDATLX,A
+        RR   A
+        MOV  _GPIFSGLDATLX,A
+        RR   A
+        MOV  _GPIFSGLDATLX,A
+        RR   A
+        MOV  _GPIFSGLDATLX,A
+        RR   A
+        MOV  _GPIFSGLDATLX,A
+        RR   A
+        MOV  _GPIFSGLDATLX,A
+        RR   A
+        MOV  _GPIFSGLDATLX,A
+        DJNZ R7,00001$
+        ANL  A,#1
+        MOV  _tdi,A
+        ret
+	__endasm;
+}
+
+void ProgIO_ShiftTMS(unsigned char tms, unsigned char n)
+{
+	/* Clock out N (1..8) bits from TMS, TDI is left unchanged */
+
+	(void)tms; /* argument passed in DPL */
+	(void)n;   /* argument passed in _ProgIO_ShiftTMS_PARM_2 */
+
+	__asm
+        LCALL _TckIdleLow
+        MOV  A,DPL
+        MOV  R7,_ProgIO_ShiftTMS_PARM_2
+        MOV  R6,_tdi
+00001$:
+        RRC  A
+        MOV  _TMS,C
+        MOV  _GPIFSGLDATLX,R6
+        DJNZ R7,00001$
+        ret
+	__endasm;
+}
+
+void ProgIO_Clock(unsigned long n)
+{
+	/* Run N (1..2^24) TCK cycles, TMS and TDI are left unchanged.
+	 * Counts down like the hw_basic version, see there. */
+
+	(void)n;
+
+	__asm
+        LCALL _TckIdleLow
+        MOV  R7,DPL
+        MOV  R6,DPH
+        MOV  R5,B
+        MOV  A,R7
+        JZ   00001$
+        MOV  A,R6
+        ADD  A,#1
+        MOV  R6,A
+        MOV  A,R5
+        ADDC A,#0
+        MOV  R5,A
+00001$:
+        MOV  A,R6
+        JZ   00002$
+        INC  R5
+00002$:
+        MOV  A,_tdi
+00003$:
+        MOV  _GPIFSGLDATLX,A
+        DJNZ R7,00003$
+        DJNZ R6,00003$
+        DJNZ R5,00003$
+        ret
+	__endasm;
+}
+
+unsigned char ProgIO_ShiftInOut(unsigned char c)
+{
+	/* Shift out byte C, shift in from TDO:
+	 *
+	 * 8x {
+	 *   Read carry from TDO
+	 *   Trigger a pulse with c, the GPIF drives c.0 on TDI
+	 *   Shift c right, append carry (TDO) at left
+	 * }
+	 * Return c.
+	 *
+	 * TDO is sampled before the rising edge of TCK, while TCK is low,
+	 * like in hw_basic.
+	 */
+
+	(void)c; /* argument passed in DPL */
+
+	__asm
+        LCALL _TckIdleLow
+        MOV  A,DPL
+        MOV  R7,#8
+00001$:
+        MOV  C,_TDO
+        MOV  _GPIFSGLDATLX,A
+        MOV  _tdi,A
+        RRC  A
+        DJNZ R7,00001$
+
+        ANL  _tdi,#1
+        MOV  DPL,A
+        ret
+	__endasm;
+
+	/* return value in DPL */
+	return c;
+}
+
+void ProgIO_ShiftInOut_Block(unsigned char n)
+{
+	/* Shift N (1..256, 0 means 256) bytes read through XAUTODAT1, each
+	 * like in ProgIO_ShiftInOut, and write the results through XAUTODAT2 */
+
+	(void)n; /* argument passed in DPL */
+
+	__asm
+        LCALL _TckIdleLow
+        MOV  R6,DPL
+00001$:
+        MOV  DPTR,#0xE67B ;; XAUTODAT1
+        MOVX A,@DPTR
+        MOV  R7,#8
+00002$:
+        MOV  C,_TDO
+        MOV  _GPIFSGLDATLX,A
+        MOV  _tdi,A
+        RRC  A
+        DJNZ R7,00002$
+
+        MOV  DPTR,#0xE67C ;; XAUTODAT2
+        MOVX @DPTR,A
+        DJNZ R6,00001$
+
+        ANL  _tdi,#1
+        ret
+	__endasm;
+}
+
+unsigned char ProgIO_SetSpeed(unsigned char s)
+{
+	/* The waveforms have a fixed TCK speed, so there's only speed 0 */
+	(void)s;
+	return 0;
+}
+
+unsigned char ProgIO_SetAdaptive(unsigned char on)
+{
+	/* No RTCK input, the waveforms can't wait for it */
+	(void)on;
+	return 0;
+}
+
+unsigned char ProgIO_SetSampleDelay(unsigned char d)
+{
+	/* TDO is always sampled before the pulse is triggered */
+	(void)d;
+	return 0;
+}
@@ -17,128 +17,1902 @@
 //-----------------------------------------------------------------------------
 // Define USE_MOD256_OUTBUFFER:
 // Saves about 256 bytes in code size, improves speed a little.
-// A further optimization could be not to use an extra output buffer at
-// all, but to write directly into EP1INBUF. Not implemented yet. When
-// downloading large amounts of data _to_ the target, there is no output
+// When downloading large amounts of data _to_ the target, there is no output
 // and thus the output buffer isn't used at all and doesn't slow down things.
+//
+// Define USE_DIRECT_INBUF:
+// Don't use an extra output buffer at all, but write read-back data directly
+// into EP1INBUF through the second autopointer. The 0x31,0x60 header is
+// written when a packet is opened and the packet is committed as soon as it
+// holds 64 bytes. This removes the copy loop and the per-byte bookkeeping
+// for read-heavy scans. OutBuffer and USE_MOD256_OUTBUFFER are unused then.
+
+//
+// Define PROTOCOL_MPSSE (make PROTOCOL=MPSSE):
+// Speak the command set of the FT2232 MPSSE instead of the USB-Blaster
+// protocol, see the MPSSE section below. PROTOCOL_BLASTER is the default.
+//
+// Define PROTOCOL_XPCU (make PROTOCOL=XPCU):
+// Look like a Xilinx Platform Cable USB to hosts, see the XPCU section below.
+// Interface 1 then has EP6 IN for TDO data instead of EP6 OUT.
+//
+// Define PROTOCOL_BLASTER2 (make PROTOCOL=BLASTER2):
+// Look like a USB-Blaster II with its firmware loaded, 09FB:6010 (hosts take
+// 09FB:6810 for one that still needs firmware). The command set is that of
+// the USB-Blaster, but commands come through EP4 OUT and read-back leaves
+// through EP8 IN without status bytes, both with 512 byte packets at high
+// speed. Interface 1 keeps EP6 OUT, its IN endpoint becomes EP1 IN, which
+// isn't fed by the FIFO interface.
+//
+// Define USE_XSVF_PLAYER:
+// Include the XSVF player, which runs XSVF files streamed through EP2 OUT on
+// the device, see the XSVF section below. Takes about 1.5K of code and 800
+// bytes of XDATA. The XPCU personality doesn't have it. Off by default,
+// since together with everything else it may not fit into the 6K of code
+// the Makefile allows (--code-size 0x1800); check the link map after
+// enabling it.
+
+#define USE_MOD256_OUTBUFFER 1
+#define USE_DIRECT_INBUF 1
+//#define USE_XSVF_PLAYER 1
+
+#ifdef PROTOCOL_XPCU
+#undef USE_XSVF_PLAYER
+#endif
+
+//-----------------------------------------------------------------------------
+typedef bit BOOL;
+#define FALSE 0
+#define TRUE  1
+
+/* Endpoints the command parser reads from and writes high speed read-back
+ * to, and bytes of FTDI status in front of every read-back packet */
+#ifdef PROTOCOL_BLASTER2
+#define CMD_FIFOBUF      EP4FIFOBUF
+#define CMD_BCH          EP4BCH
+#define CMD_BCL          EP4BCL
+#define bmCMD_EMPTY      bmEP4EMPTY
+#define CMD_FIFO         0x04
+#define IN_FIFO          0x08
+#define IN_HEADER        0
+#else
+#define CMD_FIFOBUF      EP2FIFOBUF
+#define CMD_BCH          EP2BCH
+#define CMD_BCL          EP2BCL
+#define bmCMD_EMPTY      bmEP2EMPTY
+#define CMD_FIFO         0x02
+#define IN_FIFO          0x04
+#define IN_HEADER        2
+#endif
+
+/* Protocol extensions, enabled with vendor request 0x95 */
+#define EXT_COMMANDS     bmBIT0 /* extended commands after 0x80/0xC0 */
+#define EXT_PACKED_TDO   bmBIT1 /* pack 8 bit banging TDO samples per byte */
+#define EXT_ADAPTIVE     bmBIT2 /* adaptive read-back flush and keepalive policy */
+#define EXT_ALL          (EXT_COMMANDS|EXT_PACKED_TDO|EXT_ADAPTIVE)
+
+/* FTDI vendor requests. SIO_RESET has the same number as RQ_GET_STATUS */
+#define SIO_RESET             0x00
+#define SIO_SET_LATENCY_TIMER 0x09
+#define SIO_GET_LATENCY_TIMER 0x0A
+
+/* wValue of SIO_RESET. RX and TX as seen from the chip, like on real FTDI
+ * parts: PURGE_RX drops host to chip data (commands), PURGE_TX chip to host
+ * data (read-back). Older libftdi versions document it the other way. */
+#define SIO_RESET_SIO         0
+#define SIO_RESET_PURGE_RX    1
+#define SIO_RESET_PURGE_TX    2
+
+/* Default latency in ms, same as the former fixed 100 Hz keepalive */
+#define DEFAULT_LATENCY  10
+/* In adaptive mode, idle keepalives are only sent every n latency periods */
+#define IDLE_KEEPALIVE_PERIODS 8
+
+/* Timer2 runs at CLKOUT/12 = 4 MHz, reload for a 1 kHz latency timer tick */
+#define TIMER2_RELOAD    (65536 - 48000000/12/1000)
+
+/* Bytes shifted per direction by MeasureTCK, 8 TCK cycles each */
+#define MEASURE_BYTES    8
+
+/* TDO sample delay calibration: pattern length in bytes, number of delays */
+#define CAL_BYTES        8
+#define CAL_DELAYS       3
+
+/* Extended command parser states */
+#define EXT_IDLE         0
+#define EXT_OPCODE       1
+#define EXT_ARGS         2
+#define EXT_TAIL         3 /* MPSSE: the last byte of a 65536 byte shift is due */
+
+/* Extended command opcodes */
+#define XCMD_LONG_SHIFT  0x01 /* count (16 bit LE), then count bytes like byte shift mode */
+#define XCMD_BIT_SHIFT   0x02 /* param, data: shift 1..8 bits, TMS on last bit */
+#define XCMD_TMS         0x03 /* param, tms: clock 1..8 TMS bits */
+#define XCMD_CLOCK       0x04 /* param, count (24 bit LE): idle clocks */
+#define XCMD_READ_FILL   0x05 /* count (16 bit LE), fill: read-only byte shift */
+#define XCMD_FLUSH_TDO   0x06 /* send partial byte of packed TDO samples */
+#define XCMD_COMPARE     0x07 /* count (16 bit LE), then count triples TDI, expected TDO, mask */
+#define XCMD_CMP_STATUS  0x08 /* read: mismatch flag, write: clear compare state */
+static BOOL Running;
+static BOOL WriteOnly;
+
+static WORD ClockBytes;
+static WORD EP2Offset;   /* bytes of the current command packet already processed */
+
+static BYTE PinState;    /* last bit banging byte, without the read bit */
+
+static BYTE Extensions;  /* protocol extensions enabled by the host */
+static BYTE ExtState;    /* parser state for extended commands */
+static BYTE ExtOpcode;
+static BOOL ExtRead;
+static BYTE ExtArgCount;
+static BYTE ExtArgs[4];
+
+static WORD FillBytes;   /* pending bytes of a read-only shift */
+static BYTE FillByte;    /* TDI pattern for the read-only shift */
+
+static WORD CompareBytes;  /* pending bytes of a compare shift */
+static BYTE ComparePhase;  /* next byte of a triple: 0 TDI, 1 expected, 2 mask */
+static BYTE CompareTdo;    /* TDO and expected byte of a split triple */
+static BYTE CompareExp;
+static BOOL CompareFail;   /* sticky mismatch flag */
+static unsigned long CompareCount;      /* bytes compared since the last clear */
+static unsigned long CompareFailOffset; /* first failing byte */
+static BYTE CompareFailBits;            /* and its failing bits */
+
+static BYTE TdoBits;     /* packed TDO samples from bit banging */
+static BYTE TdoMask;     /* where the next sample goes, 1 if none pending */
+
+static BOOL HsReadback;  /* read-back through EP4 IN instead of EP1 IN */
+static WORD InPacketLen; /* max. IN packet size incl. header bytes */
+
+static BYTE Latency;      /* latency timer in ms, set by the host */
+static BYTE LatencyTicks; /* ms since the last IN packet */
+static BYTE IdlePeriods;  /* latency periods without read-back data */
+static BOOL FlushDue;     /* latency timer expired */
+static BOOL KeepaliveDue; /* a short packet should follow the last data */
+
+static BYTE TckSpeed;     /* TCK speed as set through ProgIO_SetSpeed */
+
+#ifdef PROTOCOL_MPSSE
+
+/* bcdDevice of a FT2232C/D, hosts pick the MPSSE variant by it */
+#define MPSSE_VERSION    0x0500
+
+extern xdata char dscr_vidpidver[6];
+extern xdata char dscr_fs_vidpidver[6];
+
+static BOOL MsbFirst;     /* current shift is MSB first */
+static BYTE MpsseLow;     /* ADBUS value set by the host */
+static BYTE MpsseHigh;    /* ACBUS value set by the host */
+static WORD MpsseDivisor; /* clock divisor set by the host */
+static BOOL MpsseDiv5;    /* 12 MHz master clock instead of 60 MHz */
+
+#endif
+
+#ifdef PROTOCOL_XPCU
+
+/* IDs of a Platform Cable USB with its firmware loaded */
+#define XPCU_VID         0x03FD
+#define XPCU_PID         0x0008
+
+/* Versions reported through request 0xB0, wValue 0x0050 */
+#define XPCU_FW_VERSION   0x0404
+#define XPCU_CPLD_VERSION 0x0000
+
+/* The only vendor request of the XPCU protocol, wValue selects the function */
+#define XPCU_REQUEST     0xB0
+
+extern xdata char dscr_vidpidver[6];
+extern xdata char dscr_fs_vidpidver[6];
+extern xdata char dscr_ep6[1];
+extern xdata char dscr_fs_ep6[1];
+
+static WORD XpcuBits;     /* bits of the current shift still to be done */
+static WORD XpcuTdo;      /* TDO samples, shifted in from the top */
+static BYTE XpcuTdoCount; /* number of samples in XpcuTdo */
+static WORD XpcuInCount;  /* bytes in the EP6 IN buffer */
+
+#endif
+
+#ifdef USE_XSVF_PLAYER
+
+/* XSVF opcodes */
+#define XCOMPLETE        0x00
+#define XTDOMASK         0x01
+#define XSIR             0x02
+#define XSDR             0x03
+#define XRUNTEST         0x04
+#define XREPEAT          0x07
+#define XSDRSIZE         0x08
+#define XSDRTDO          0x09
+#define XSDRB            0x0C
+#define XSDRC            0x0D
+#define XSDRE            0x0E
+#define XSDRTDOB         0x0F
+#define XSDRTDOC         0x10
+#define XSDRTDOE         0x11
+#define XSTATE           0x12
+#define XENDIR           0x13
+#define XENDDR           0x14
+#define XSIR2            0x15
+#define XCOMMENT         0x16
+#define XWAIT            0x17
+
+/* TAP states, numbered like in XSTATE */
+#define TAP_RESET        0x00
+#define TAP_IDLE         0x01
+#define TAP_SHIFTDR      0x04
+#define TAP_PAUSEDR      0x06
+#define TAP_SHIFTIR      0x0B
+#define TAP_PAUSEIR      0x0D
+
+/* Player status, and errors numbered like in the Xilinx reference player */
+#define XSVF_IDLE        0
+#define XSVF_RUNNING     1
+#define XSVF_COMPLETE    2
+#define XSVF_FAILED      3
+
+#define XSVF_ERROR_NONE         0
+#define XSVF_ERROR_TDOMISMATCH  2
+#define XSVF_ERROR_ILLEGALCMD   4
+#define XSVF_ERROR_ILLEGALSTATE 5
+#define XSVF_ERROR_DATAOVERFLOW 6
+#define XSVF_ERROR_ABORTED      7
+
+/* Shift flags */
+#define XSVF_EXIT        bmBIT0 /* leave the shift state with the last bit */
+#define XSVF_CMP         bmBIT1 /* compare TDO */
+#define XSVF_RUNTEST     bmBIT2 /* wait XRUNTEST and retry mismatches */
+
+#define XSVF_MAX_BYTES   256    /* longest vector, 2048 bits */
+#define XSVF_DEF_REPEAT  32     /* retries until the first XREPEAT */
+
+static BOOL XsvfActive;    /* the player takes the EP2 stream */
+static BOOL XsvfInCommand; /* collecting the bytes of a command */
+static BYTE XsvfStatus;
+static BYTE XsvfError;
+static BYTE XsvfOpcode;    /* current (or last) command */
+static BYTE XsvfPhase;     /* field of the command being collected */
+static WORD XsvfCount;     /* bytes still due for that field */
+static xdata BYTE *XsvfDest; /* where they go */
+static BYTE XsvfTap;       /* current TAP state */
+static BYTE XsvfEndIR;     /* state after XSIR */
+static BYTE XsvfEndDR;     /* state after XSDR and friends */
+static BYTE XsvfRepeat;    /* XREPEAT */
+static WORD XsvfSdrBits;   /* XSDRSIZE */
+
+static xdata unsigned long XsvfRunTest;   /* XRUNTEST in us */
+static xdata unsigned long XsvfOffset;    /* bytes of the stream taken */
+static xdata unsigned long XsvfCmdOffset; /* where the current command began */
+
+static xdata BYTE XsvfArgs[6];
+static xdata BYTE XsvfTdi[XSVF_MAX_BYTES];
+static xdata BYTE XsvfTdoExp[XSVF_MAX_BYTES];
+static xdata BYTE XsvfTdoMask[XSVF_MAX_BYTES];
+static xdata BYTE XsvfPrev[16];  /* for the TAP path search */
+static xdata BYTE XsvfQueue[16];
+
+#endif
+
+#ifdef PROTOCOL_BLASTER2
+
+/* IDs of a USB-Blaster II with its firmware loaded. Without firmware, it
+ * enumerates as 09FB:6810, and hosts would try to upload it. */
+#define BLASTER2_VID     0x09FB
+#define BLASTER2_PID     0x6010
+
+extern xdata char dscr_vidpidver[6];
+extern xdata char dscr_fs_vidpidver[6];
+
+#endif
+
+#ifdef USE_DIRECT_INBUF
+
+/* Number of bytes in the IN packet including the header bytes,
+ * zero if no IN packet is currently open */
+static WORD InCount;
+
+#else
+
+static WORD Pending;
+
+#ifdef USE_MOD256_OUTBUFFER
+static BYTE FirstDataInOutBuffer;
+static BYTE FirstFreeInOutBuffer;
+#else
+static WORD FirstDataInOutBuffer;
+static WORD FirstFreeInOutBuffer;
+#endif
+
+#ifdef USE_MOD256_OUTBUFFER
+/* Size of output buffer must be exactly 256 */
+#define OUTBUFFER_LEN 0x100
+/* Output buffer must begin at some address with lower 8 bits all zero */
+xdata at 0xE000 BYTE OutBuffer[OUTBUFFER_LEN];
+#else
+#define OUTBUFFER_LEN 0x200
+static xdata BYTE OutBuffer[OUTBUFFER_LEN];
+#endif
+
+#endif /* USE_DIRECT_INBUF */
+
+#ifdef PROTOCOL_BLASTER2
+/* Move the endpoints of a configuration descriptor to where Blaster II hosts
+ * look for them: commands on EP4 OUT, read-back on EP8 IN, both with MAXP
+ * bytes. The IN endpoint of interface 1 gives way to EP1 IN. */
+static void Blaster2Endpoints(xdata BYTE *d, WORD maxp)
+{
+	xdata BYTE *end = d + (d[2] | (d[3] << 8));
+
+	for(; d < end; d += d[0]) {
+		if(d[1] != DT_ENDPOINT) continue;
+		switch(d[2]) {
+			case 0x81: // read-back, alternate setting 0
+			case 0x84: // read-back, alternate setting 1
+				d[2] = 0x88;
+				d[4] = LSB(maxp);
+				d[5] = MSB(maxp);
+				break;
+			case 0x02: // commands
+				d[2] = 0x04;
+				d[4] = LSB(maxp);
+				d[5] = MSB(maxp);
+				break;
+			case 0x88: // user data of interface 1
+				d[2] = 0x81;
+				d[4] = 0x40;
+				d[5] = 0;
+				break;
+		}
+	}
+}
+#endif
+
+/* Clear the result of TDO compare shifts */
+static void CompareClear(void)
+{
+	CompareFail = FALSE;
+	CompareCount = 0;
+	CompareFailOffset = 0;
+	CompareFailBits = 0;
+}
+
+//-----------------------------------------------------------------------------
+void usb_jtag_init(void)
+{
+	WORD tmp;
+
+	Running = FALSE;
+	ClockBytes = 0;
+	EP2Offset = 0;
+	WriteOnly = TRUE;
+	PinState = 0;
+	Extensions = 0;
+	ExtState = EXT_IDLE;
+	FillBytes = 0;
+	CompareBytes = 0;
+	ComparePhase = 0;
+	CompareClear();
+#ifdef USE_XSVF_PLAYER
+	XsvfActive = FALSE;
+	XsvfStatus = XSVF_IDLE;
+	XsvfError = XSVF_ERROR_NONE;
+	XsvfOpcode = XCOMPLETE;
+	XsvfCmdOffset = 0;
+	XsvfTap = TAP_RESET;
+#endif
+	TdoBits = 0;
+	TdoMask = 1;
+	HsReadback = FALSE;
+	InPacketLen = 0x40;
+	Latency = DEFAULT_LATENCY;
+	LatencyTicks = 0;
+	IdlePeriods = 0;
+	FlushDue = FALSE;
+	KeepaliveDue = FALSE;
+#ifdef PROTOCOL_MPSSE
+	MsbFirst = FALSE;
+	MpsseLow = 0;
+	MpsseHigh = 0;
+	MpsseDivisor = 0;
+	MpsseDiv5 = TRUE;
+
+	dscr_vidpidver[4] = dscr_fs_vidpidver[4] = LSB(MPSSE_VERSION);
+	dscr_vidpidver[5] = dscr_fs_vidpidver[5] = MSB(MPSSE_VERSION);
+#endif
+#ifdef PROTOCOL_XPCU
+	XpcuBits = 0;
+	XpcuTdo = 0;
+	XpcuTdoCount = 0;
+	XpcuInCount = 0;
+
+	dscr_vidpidver[0] = dscr_fs_vidpidver[0] = LSB(XPCU_VID);
+	dscr_vidpidver[1] = dscr_fs_vidpidver[1] = MSB(XPCU_VID);
+	dscr_vidpidver[2] = dscr_fs_vidpidver[2] = LSB(XPCU_PID);
+	dscr_vidpidver[3] = dscr_fs_vidpidver[3] = MSB(XPCU_PID);
+	dscr_ep6[0] = dscr_fs_ep6[0] = 0x86; // EP6 IN
+#endif
+#ifdef PROTOCOL_BLASTER2
+	Running = TRUE; // No FTDI reset from Blaster II hosts
+
+	dscr_vidpidver[0] = dscr_fs_vidpidver[0] = LSB(BLASTER2_VID);
+	dscr_vidpidver[1] = dscr_fs_vidpidver[1] = MSB(BLASTER2_VID);
+	dscr_vidpidver[2] = dscr_fs_vidpidver[2] = LSB(BLASTER2_PID);
+	dscr_vidpidver[3] = dscr_fs_vidpidver[3] = MSB(BLASTER2_PID);
+	Blaster2Endpoints((xdata BYTE *)high_speed_config_descr, 0x200);
+	Blaster2Endpoints((xdata BYTE *)full_speed_config_descr, 0x40);
+#endif
+#ifdef USE_DIRECT_INBUF
+	InCount = 0;
+#else
+	Pending = 0;
+	FirstDataInOutBuffer = 0;
+	FirstFreeInOutBuffer = 0;
+#endif
+
+	ProgIO_Init();
+	TckSpeed = 0;
+
+	// Make Timer2 reload at 1 kHz to run the latency timer
+	tmp = TIMER2_RELOAD;
+	RCAP2H = tmp >> 8;
+	RCAP2L = tmp & 0xFF;
+	CKCON = 0; // Default Clock
+	T2CON = 0x04; // Auto-reload mode using internal clock, no baud clock.
+
+	// Enable Autopointer
+	EXTACC = 1; // Enable
+	APTR1FZ = 1; // Don't freeze
+	APTR2FZ = 1; // Don't freeze
+
+	// define endpoint configuration
+
+	REVCTL = 3; SYNCDELAY; // Allow FW access to FIFO buffer
+	FIFORESET = 0x80; SYNCDELAY; // From now on, NAK all, reset all FIFOS
+	FIFORESET  = 0x02; SYNCDELAY; // Reset FIFO 2
+	FIFORESET  = 0x04; SYNCDELAY; // Reset FIFO 4
+	FIFORESET  = 0x06; SYNCDELAY; // Reset FIFO 6
+	FIFORESET  = 0x08; SYNCDELAY; // Reset FIFO 8
+	FIFORESET  = 0x00; SYNCDELAY; // Restore normal behaviour
+
+	EP1OUTCFG  = 0xA0; SYNCDELAY; // Endpoint 1 Type Bulk
+	EP1INCFG   = 0xA0; SYNCDELAY; // Endpoint 1 Type Bulk
+
+	EP2FIFOCFG = 0x00; SYNCDELAY; // Endpoint 2
+	EP2CFG     = 0xA2; SYNCDELAY; // Endpoint 2 Valid, Out, Type Bulk, Double buffered
+
+	EP4FIFOCFG = 0x00; SYNCDELAY; // Endpoint 4
+#ifdef PROTOCOL_BLASTER2
+	EP4CFG     = 0xA2; SYNCDELAY; // Endpoint 4 Valid, Out, Type Bulk, Double buffered (commands)
+#else
+	EP4CFG     = 0xE2; SYNCDELAY; // Endpoint 4 Valid, In, Type Bulk, Double buffered (high speed read-back)
+#endif
+
+	REVCTL = 0; SYNCDELAY; // Reset FW access to FIFO buffer, enable auto-arming when AUTOOUT is switched to 1
+
+#ifdef PROTOCOL_XPCU
+	EP6CFG     = 0xE2; SYNCDELAY; // In endpoint, Bulk, Double buffering
+	EP6FIFOCFG = 0x00; SYNCDELAY; // TDO data, committed by the firmware
+#else
+	EP6CFG     = 0xA2; SYNCDELAY; // Out endpoint, Bulk, Double buffering
+	EP6FIFOCFG = 0x00; SYNCDELAY; // Firmware has to see a rising edge on auto bit to enable auto arming
+	EP6FIFOCFG = bmAUTOOUT | bmWORDWIDE; SYNCDELAY; // Endpoint 6 used for user communicationn, auto commitment, 16 bits data bus
+#endif
+
+	EP8CFG     = 0xE0; SYNCDELAY; // In endpoint, Bulk
+	EP8FIFOCFG = 0x00; SYNCDELAY; // Firmware has to see a rising edge on auto bit to enable auto arming
+#ifndef PROTOCOL_BLASTER2
+	EP8FIFOCFG = bmAUTOIN  | bmWORDWIDE; SYNCDELAY; // Endpoint 8 used for user communication, auto commitment, 16 bits data bus
+#endif
+
+	EP8AUTOINLENH = 0x00; SYNCDELAY; // Size in bytes of the IN data automatically commited (64 bytes here, but changed dynamically depending on the connection)
+	EP8AUTOINLENL = 0x40; SYNCDELAY; // Can use signal PKTEND if you want to commit a shorter packet
+
+	// Out endpoints do not come up armed
+	// Since the defaults are double buffered we must write dummy byte counts twice
+	EP2BCL = 0x80; SYNCDELAY; // Arm EP2OUT by writing byte count w/skip
+	EP2BCL = 0x80; SYNCDELAY;
+#ifdef PROTOCOL_BLASTER2
+	EP4BCL = 0x80; SYNCDELAY; // Arm EP4OUT the same way
+	EP4BCL = 0x80; SYNCDELAY;
+#endif
+
+	// JTAG from FX2 enabled by default
+	IOC |= (1 << 7);
+
+	// Put the system in high speed by default (REM: USB-Blaster is in full speed)
+	// This can be changed by vendor commands
+	CT1 &= ~0x02;
+	// Put the FIFO in sync mode
+	IFCONFIG &= ~bmASYNC;
+}
+
+//-----------------------------------------------------------------------------
+#if defined(PROTOCOL_MPSSE) || defined(PROTOCOL_XPCU)
+static BYTE Reverse(BYTE d)
+{
+	BYTE i, r = 0;
+
+	for(i = 0; i < 8; i++) {
+		r = (r << 1) | (d & 1);
+		d >>= 1;
+	}
+	return r;
+}
+#endif
+
+#ifdef PROTOCOL_XPCU
+
+//-----------------------------------------------------------------------------
+// Xilinx Platform Cable USB protocol (PROTOCOL_XPCU). Everything is done
+// with vendor request 0xB0, wValue selects the function:
+//
+//   OUT 0x0010, 0x0018  output enable off, on (nothing to do here)
+//   OUT 0x0028          (nothing to do here)
+//   OUT 0x0030          set pins from wIndex: TDI bit 0, TMS bit 1, TCK bit 2
+//   OUT 0x0052          select internal or external pins (nothing to do here)
+//   OUT 0x00A6          shift wIndex+1 bits, see below
+//   IN  0x0020          wIndexL with its bit order reversed
+//   IN  0x0038          read pins, TDO in bit 0
+//   IN  0x0050          firmware (wIndex 0) or CPLD (wIndex 1) version, LE
+//
+// After 0x00A6, the host sends 16 bit words (LE) through EP2 OUT, each for up
+// to 4 bits, with the first bit in the lowest bit of every nibble: TDI in
+// bits 0..3, TMS in bits 4..7, sample TDO in bits 8..11 and pulse TCK in
+// bits 12..15. TDO is sampled before the pulse. The samples go back through
+// EP6 IN in 16 bit words (LE), filled from the top, so the bits of the last
+// partial word are at its top end. The rest of an EP2 packet after the
+// last bit of a shift is dropped.
+//
+// Two words which pulse TCK for all 8 bits, keep TMS and sample TDO for
+// none or all of them go through ProgIO_ShiftOut or ProgIO_ShiftInOut as
+// one byte, everything else is bit banged.
+//-----------------------------------------------------------------------------
+
+#define XpcuPacketLen() ((USBCS & bmHSM) ? 0x200 : 0x40)
+
+static void XpcuCommit(void)
+{
+	SYNCDELAY;
+	EP6BCH = MSB( XpcuInCount );
+	SYNCDELAY;
+	EP6BCL = LSB( XpcuInCount );
+	XpcuInCount = 0;
+}
+
+/* The caller makes sure that EP6 has room, see usb_jtag_activity() */
+static void XpcuTdoWord(void)
+{
+	EP6FIFOBUF[XpcuInCount++] = LSB(XpcuTdo);
+	EP6FIFOBUF[XpcuInCount++] = MSB(XpcuTdo);
+	XpcuTdo = 0;
+	XpcuTdoCount = 0;
+	if(XpcuInCount == XpcuPacketLen()) XpcuCommit();
+}
+
+/* Add N (1 or 8) TDO samples, first one in bit 0 of S */
+static void XpcuTdoBits(BYTE s, BYTE n)
+{
+	if(n == 8) {
+		XpcuTdo = (XpcuTdo >> 8) | ((WORD)s << 8);
+	} else {
+		XpcuTdo >>= 1;
+		if(s & 1) XpcuTdo |= 0x8000;
+	}
+	XpcuTdoCount += n;
+	if(XpcuTdoCount == 16) XpcuTdoWord();
+}
+
+/* Do K (1..4) bits of a word */
+static void XpcuWord(BYTE lo, BYTE hi, BYTE k)
+{
+	BYTE b;
+
+	for(b = 1; k > 0; k--, b <<= 1) {
+		PinState &= ~(bmBIT0|bmBIT1|bmBIT4);
+		if(lo & b) PinState |= bmBIT4;
+		if(lo & (b << 4)) PinState |= bmBIT1;
+
+		if(hi & b) XpcuTdoBits(ProgIO_Set_Get_State(PinState), 1);
+		else ProgIO_Set_State(PinState);
+
+		if(hi & (b << 4)) {
+			ProgIO_Set_State(PinState | bmBIT0);
+			ProgIO_Set_State(PinState);
+		}
+	}
+}
+
+/* Do two words as one byte if they allow it, see above */
+static BOOL XpcuByte(BYTE lo0, BYTE hi0, BYTE lo1, BYTE hi1)
+{
+	BYTE tms = (PinState & bmBIT1) ? 0xF0 : 0x00;
+	BYTE tdo = hi0 & 0x0F;
+	BYTE d;
+
+	if((hi0 & 0xF0) != 0xF0 || (hi1 & 0xF0) != 0xF0) return FALSE;
+	if((lo0 & 0xF0) != tms || (lo1 & 0xF0) != tms) return FALSE;
+	if((hi1 & 0x0F) != tdo || (tdo != 0 && tdo != 0x0F)) return FALSE;
+	if(tdo != 0 && XpcuTdoCount > 8) return FALSE;
+
+	d = (lo0 & 0x0F) | (lo1 << 4);
+	if(tdo != 0) XpcuTdoBits(ProgIO_ShiftInOut(d), 8);
+	else ProgIO_ShiftOut(d);
+
+	if(d & 0x80) PinState |= bmBIT4;
+	else PinState &= ~bmBIT4;
+
+	return TRUE;
+}
+
+/* Send the last partial word and packet of a shift, once EP6 has room */
+static void XpcuFinish(void)
+{
+	if(XpcuTdoCount == 0 && XpcuInCount == 0) return;
+	if(XpcuInCount == 0 && (EP2468STAT & bmEP6FULL)) return;
+
+	if(XpcuTdoCount > 0) XpcuTdoWord();
+	if(XpcuInCount > 0) XpcuCommit();
+}
+
+static void XpcuVendorOut(void)
+{
+	switch(wValueL) {
+		case 0x30: // set pins
+			PinState &= ~(bmBIT0|bmBIT1|bmBIT4);
+			if(wIndexL & bmBIT0) PinState |= bmBIT4;
+			if(wIndexL & bmBIT1) PinState |= bmBIT1;
+			if(wIndexL & bmBIT2) PinState |= bmBIT0;
+			ProgIO_Set_State(PinState);
+			break;
+		case 0xA6: // shift
+			XpcuBits = (wIndexL | (wIndexH << 8)) + 1;
+			XpcuTdo = 0;
+			XpcuTdoCount = 0;
+			break;
+		default: // output enable, pin selection
+			break;
+	}
+}
+
+static void XpcuVendorIn(void)
+{
+	WORD v = 0;
+
+	switch(wValueL) {
+		case 0x20: // reverse bits
+			v = Reverse(wIndexL);
+			break;
+		case 0x38: // read pins
+			v = ProgIO_Set_Get_State(PinState) & bmBIT0;
+			break;
+		case 0x50: // versions
+			v = wIndexL ? XPCU_CPLD_VERSION : XPCU_FW_VERSION;
+			break;
+	}
+
+	EP0BUF[0] = LSB(v);
+	EP0BUF[1] = MSB(v);
+	EP0BCH = 0; // Arm endpoint
+	EP0BCL = (wLengthL<2) ? wLengthL : 2;
+}
+
+//-----------------------------------------------------------------------------
+void usb_jtag_activity(void)
+{
+	WORD i, n;
+
+	if(XpcuBits == 0) {
+		XpcuFinish();
+		return;
+	}
+	if(EP2468STAT & bmEP2EMPTY) return;
+
+	n = EP2BCL | (EP2BCH << 8);
+	i = EP2Offset;
+
+	APTR1H = MSB( &(EP2FIFOBUF[i]) );
+	APTR1L = LSB( &(EP2FIFOBUF[i]) );
+
+	while(i + 1 < n && XpcuBits > 0) {
+		BYTE lo, hi;
+
+		/* Up to 8 bits give at most one TDO word, which always fits
+		 * into an open packet */
+		if(XpcuInCount == 0 && (EP2468STAT & bmEP6FULL)) break;
+
+		lo = XAUTODAT1;
+		hi = XAUTODAT1;
+		i += 2;
+
+		if(XpcuBits >= 8 && i + 1 < n) {
+			BYTE lo1 = XAUTODAT1;
+			BYTE hi1 = XAUTODAT1;
+			i += 2;
+			XpcuBits -= 8;
+			if(!XpcuByte(lo, hi, lo1, hi1)) {
+				XpcuWord(lo, hi, 4);
+				XpcuWord(lo1, hi1, 4);
+			}
+		} else if(XpcuBits >= 4) {
+			XpcuBits -= 4;
+			XpcuWord(lo, hi, 4);
+		} else {
+			XpcuWord(lo, hi, XpcuBits);
+			XpcuBits = 0;
+		}
+	}
+
+	if(i + 1 < n && XpcuBits > 0) {
+		EP2Offset = i;
+	} else {
+		EP2Offset = 0;
+		SYNCDELAY;
+		EP2BCL = 0x80; // Re-arm endpoint 2
+	}
+
+	if(XpcuBits == 0) XpcuFinish();
+}
+
+#else /* PROTOCOL_XPCU */
+
+//-----------------------------------------------------------------------------
+// Read-back data normally leaves through EP1 IN in packets of up to 64 bytes.
+// When running at high speed, the host may select alternate setting 1 of
+// interface 0 to receive it through the double buffered 512 byte EP4 IN
+// instead. The framing is just like FT2232H: two status bytes (0x31,0x60)
+// in front of every packet, followed by up to 510 bytes of data.
+//
+// The Blaster II (PROTOCOL_BLASTER2) always sends it through EP8 IN, in
+// packets of up to 512 bytes at high speed, without status bytes.
+
+#ifdef PROTOCOL_BLASTER2
+
+#define InBufferBusy() (EP2468STAT & bmEP8FULL)
+
+static void InBufferBegin(void)
+{
+	AUTOPTRH2 = MSB( EP8FIFOBUF );
+	AUTOPTRL2 = LSB( EP8FIFOBUF );
+}
+
+static void InBufferCommit(WORD n)
+{
+	LatencyTicks = 0;
+	FlushDue = FALSE;
+
+	SYNCDELAY;
+	EP8BCH = MSB( n );
+	SYNCDELAY;
+	EP8BCL = LSB( n );
+}
+
+static void SelectReadback(void)
+{
+	InPacketLen = (USBCS & bmHSM) ? 0x200 : 0x40;
+}
+
+#else /* PROTOCOL_BLASTER2 */
+
+#define InBufferBusy() \
+	(HsReadback ? (EP2468STAT & bmEP4FULL) : (EP1INCS & bmEPBUSY))
+
+static void InBufferBegin(void)
+{
+	if(HsReadback) {
+		AUTOPTRH2 = MSB( EP4FIFOBUF );
+		AUTOPTRL2 = LSB( EP4FIFOBUF );
+	} else {
+		AUTOPTRH2 = MSB( EP1INBUF );
+		AUTOPTRL2 = LSB( EP1INBUF );
+	}
+
+	XAUTODAT2 = 0x31;
+	XAUTODAT2 = 0x60;
+}
+
+static void InBufferCommit(WORD n)
+{
+	/* Restart the latency timer with every packet, like FTDI chips do */
+	LatencyTicks = 0;
+	FlushDue = FALSE;
+
+	SYNCDELAY;
+	if(HsReadback) {
+		EP4BCH = MSB( n );
+		SYNCDELAY;
+		EP4BCL = LSB( n );
+	} else {
+		EP1INBC = n;
+	}
+}
+
+static void SelectReadback(void)
+{
+	BOOL hs = FALSE;
+
+	if(_usb_alt_setting == 1 && (USBCS & bmHSM)) hs = TRUE;
+	if(hs == HsReadback) return;
+
+	HsReadback = hs;
+	InPacketLen = hs ? 0x200 : 0x40;
+}
+
+#endif /* PROTOCOL_BLASTER2 */
+
+/* The host has sent all its commands and now waits for the answers */
+#define HostWaiting() \
+	((EP2468STAT & bmCMD_EMPTY) && ClockBytes == 0 && FillBytes == 0 \
+	 && CompareBytes == 0 && ExtState == EXT_IDLE)
+
+/* In adaptive mode, partial read-back packets are held back while more
+ * commands are queued, until the latency timer expires */
+#define HoldPartial() \
+	((Extensions & EXT_ADAPTIVE) && !FlushDue && !HostWaiting())
+
+/* Advance the latency timer, Timer2 overflows once per ms */
+static void LatencyTick(void)
+{
+	if(!TF2) return;
+	TF2 = 0;
+
+	if(++LatencyTicks >= Latency) {
+		LatencyTicks = 0;
+		FlushDue = TRUE;
+	}
+}
+
+#if IN_HEADER > 0
+
+/* Send a status-only packet when one is due. The IN buffer must not be busy. */
+static void Keepalive(void)
+{
+	if(!KeepaliveDue) {
+		if(!FlushDue) return;
+		FlushDue = FALSE;
+		if((Extensions & EXT_ADAPTIVE) && ++IdlePeriods < IDLE_KEEPALIVE_PERIODS) return;
+	}
+
+	InBufferBegin();
+	InBufferCommit(IN_HEADER);
+	KeepaliveDue = FALSE;
+	IdlePeriods = 0;
+}
+
+#else
+
+/* Without status bytes, there's nothing to keep the host busy with */
+#define Keepalive()
+
+#endif
+
+#ifdef USE_DIRECT_INBUF
+
+static void InPacketOpen(void)
+{
+	/* Wait until the host took the last packet */
+	while(InBufferBusy());
+
+	InBufferBegin();
+	InCount = IN_HEADER;
+}
+
+static void InPacketCommit(void)
+{
+	InBufferCommit(InCount);
+	InCount = 0;
+	KeepaliveDue = TRUE; // Make sure there will be a short transfer soon
+	IdlePeriods = 0;
+}
+
+/* Store one byte in the IN packet, commit the packet once it is full */
+#define OutputByte(d) do { \
+		if(InCount == 0) InPacketOpen(); \
+		XAUTODAT2 = (d); \
+		if(++InCount == InPacketLen) InPacketCommit(); \
+	} while(0)
+
+#else
+
+void OutputByte(BYTE d)
+{
+#ifdef USE_MOD256_OUTBUFFER
+	OutBuffer[FirstFreeInOutBuffer] = d;
+	FirstFreeInOutBuffer = ( FirstFreeInOutBuffer + 1 ) & 0xFF;
+#else
+	OutBuffer[FirstFreeInOutBuffer++] = d;
+	if(FirstFreeInOutBuffer >= OUTBUFFER_LEN) FirstFreeInOutBuffer = 0;
+#endif
+	Pending++;
+}
+
+/* Copy pending data from OutBuffer into an IN packet and commit it.
+ * The IN buffer must not be busy. Uses both autopointers. */
+static void SendPending(void)
+{
+	WORD o, n;
+
+	InBufferBegin();
+
+	if(Pending > InPacketLen-IN_HEADER) { n = InPacketLen-IN_HEADER; Pending -= n; }
+	else { n = Pending; Pending = 0; };
+
+	o = n;
+
+#ifdef USE_MOD256_OUTBUFFER
+	APTR1H = MSB( OutBuffer );
+	APTR1L = FirstDataInOutBuffer;
+	while(n--) {
+		XAUTODAT2 = XAUTODAT1;
+		APTR1H = MSB( OutBuffer ); // Stay within 256-Byte-Buffer
+	}
+	FirstDataInOutBuffer = APTR1L;
+#else
+	APTR1H = MSB( &(OutBuffer[FirstDataInOutBuffer]) );
+	APTR1L = LSB( &(OutBuffer[FirstDataInOutBuffer]) );
+	while(n--) {
+		XAUTODAT2 = XAUTODAT1;
+		if(++FirstDataInOutBuffer >= OUTBUFFER_LEN) {
+			FirstDataInOutBuffer = 0;
+			APTR1H = MSB( OutBuffer );
+			APTR1L = LSB( OutBuffer );
+		}
+	}
+#endif
+	InBufferCommit(IN_HEADER + o);
+	KeepaliveDue = TRUE; // Make sure there will be a short transfer soon
+	IdlePeriods = 0;
+}
+
+/* Commit a full IN packet while the parser is busy with a long command.
+ * This lets the host read while shifting continues. */
+static void SendFullPacket(void)
+{
+	BYTE h, l;
+
+	if(Pending < InPacketLen-IN_HEADER || InBufferBusy()) return;
+
+	/* The parser reads CMD_FIFOBUF through the first autopointer */
+	h = APTR1H;
+	l = APTR1L;
+	SendPending();
+	APTR1H = h;
+	APTR1L = l;
+}
+
+#endif /* USE_DIRECT_INBUF */
+
+/* Number of bytes that can be output right now without waiting */
+static WORD OutputSpace(void)
+{
+#ifdef USE_DIRECT_INBUF
+	if(InCount > 0) return InPacketLen - InCount;
+	if(InBufferBusy()) return 0;
+	return InPacketLen - IN_HEADER;
+#else
+	return OUTBUFFER_LEN - Pending;
+#endif
+}
+
+/* For use in the command loop: leave it if there's no space for output */
+#define NEED_ROOM() if(room == 0 && (room = OutputSpace()) == 0) break
+
+/* Shift out M bytes read through the first autopointer */
+static void ShiftOutBlock(WORD m)
+{
+#ifdef PROTOCOL_MPSSE
+	if(MsbFirst) {
+		while(m--) ProgIO_ShiftOut(Reverse(XAUTODAT1));
+		return;
+	}
+#endif
+	while(m >= 0x100) {
+		ProgIO_ShiftOut_Block(0);
+		m -= 0x100;
+	}
+	if(m > 0) ProgIO_ShiftOut_Block(m);
+}
+
+/* Shift M bytes read through the first autopointer, the TDO bytes go to
+ * the read-back through the second one. There must be space for M bytes. */
+static void ShiftInOutBlock(WORD m)
+{
+#ifdef PROTOCOL_MPSSE
+	if(MsbFirst) {
+		while(m--) OutputByte(Reverse(ProgIO_ShiftInOut(Reverse(XAUTODAT1))));
+		return;
+	}
+#endif
+	while(m > 0) {
+		WORD k;
+#ifdef USE_DIRECT_INBUF
+		if(InCount == 0) InPacketOpen();
+		k = InPacketLen - InCount;
+#else
+		/* Don't run past the end of OutBuffer */
+		k = OUTBUFFER_LEN - FirstFreeInOutBuffer;
+		AUTOPTRH2 = MSB( &(OutBuffer[FirstFreeInOutBuffer]) );
+		AUTOPTRL2 = LSB( &(OutBuffer[FirstFreeInOutBuffer]) );
+#endif
+		if(k > m) k = m;
+		if(k > 0x100) k = 0x100;
+
+		ProgIO_ShiftInOut_Block(k); /* 0x100 is passed as 0 */
+		m -= k;
+
+#ifdef USE_DIRECT_INBUF
+		InCount += k;
+		if(InCount == InPacketLen) InPacketCommit();
+#else
+		Pending += k;
+		FirstFreeInOutBuffer += k;
+#ifndef USE_MOD256_OUTBUFFER
+		if(FirstFreeInOutBuffer >= OUTBUFFER_LEN) FirstFreeInOutBuffer = 0;
+#endif
+#endif
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Extended commands. Once enabled by the host with vendor request 0x95, a
+// byte shift header with a count of zero (0x80 or 0xC0, a no-op in the
+// original protocol) is followed by an opcode and its argument bytes. If the
+// header had the read bit (0xC0), the command returns TDO data to the host.
+//
+//   0x01 cL cH     Long byte shift: the next (cH<<8|cL) bytes are shifted
+//                  just like in byte shift mode.
+//
+//   0x02 p  x      Bit shift: shift out (p & 7)+1 bits from x, LSB first.
+//                  If p.3 is set, TMS is raised for the last bit (to leave
+//                  Shift-DR/IR), otherwise TMS is kept low. The read variant
+//                  returns one byte with the TDO bits, first bit in bit 0.
+//
+//   0x03 p  t      TMS sequence: clock (p & 7)+1 bits from t, LSB first, out
+//                  on TMS while TDI is held at p.4. The read variant returns
+//                  the TDO bits like a bit shift.
+//
+//   0x04 p  c0 c1 c2
+//                  Idle clocks: hold TMS at p.1 and TDI at p.4, then run
+//                  (c2<<16|c1<<8|c0) TCK cycles. There is no read variant.
+//
+//   0x05 cL cH f   Read-only byte shift: shift (cH<<8|cL) bytes, each of them
+//                  with TDI pattern f, and return TDO just like byte shift
+//                  mode with the read bit. No payload follows from the host.
+//
+//   0x06           Flush packed TDO samples (see below) now, if any.
+//
+//   0x07 cL cH     Compare shift: the next (cH<<8|cL) byte triples carry a
+//                  TDI byte, the expected TDO byte and a mask. The TDI byte
+//                  is shifted like in byte shift mode, TDO is compared
+//                  where the mask has ones, and nothing is returned. The
+//                  first mismatch sets a sticky flag and records its byte
+//                  offset, counted over all compare shifts since the last
+//                  clear. Use the write variant (0x80).
+//
+//   0x08           Compare status: the read variant returns a byte with
+//                  the mismatch flag in bit 0, the write variant clears the
+//                  compare state. Vendor request 0x99 returns the offset.
+//
+// Packed TDO: with protocol extension EXT_PACKED_TDO, the TDO samples of
+// bit banging bytes with the read bit aren't returned as one byte each,
+// but eight of them are packed into a byte, first sample in bit 0. A byte
+// with less than 8 samples is sent upon command 0x06, or when the latency
+// timer expires while no more commands are queued. Hosts should end each
+// batch of commands with 0x06 to get a well defined byte boundary.
+//
+// Adaptive flush: with protocol extension EXT_ADAPTIVE, partial read-back
+// packets are held back while the host still has commands queued, until
+// the latency timer (FTDI requests 0x09/0x0A, 1 ms steps) expires. Once
+// all commands are done they're sent at once, so are pending packed TDO
+// samples. Keepalives while idle are only sent every 8th latency period.
+//
+// A command may span several EP2 packets, its state is kept in ExtState.
+
+static BYTE ShiftBits(BYTE tdi, BYTE tms, BYTE n)
+{
+	BYTE s = PinState & ~(bmBIT0|bmBIT1|bmBIT4);
+	BYTE b, r = 0;
+
+	for(b = 1; n > 0; n--, b <<= 1) {
+		BYTE t = s;
+		if(tdi & b) t |= bmBIT4;
+		if(tms & b) t |= bmBIT1;
+		if(ProgIO_Set_Get_State(t) & 1) r |= b; /* TDO before rising edge */
+		ProgIO_Set_State(t | bmBIT0);
+		PinState = t;
+	}
+
+	ProgIO_Set_State(PinState);
+	return r;
+}
+
+static void ShiftTMS(BYTE p, BYTE tms)
+{
+	BYTE n = (p & 7) + 1;
+
+	PinState = (PinState & ~(bmBIT0|bmBIT4)) | (p & bmBIT4);
+
+	if(ExtRead) {
+		OutputByte(ShiftBits((p & bmBIT4) ? 0xFF : 0x00, tms, n));
+		return;
+	}
+
+	ProgIO_Set_State(PinState);
+	ProgIO_ShiftTMS(tms, n);
+
+	if(tms & (1 << (n-1)))
+		PinState |= bmBIT1;
+	else
+		PinState &= ~bmBIT1;
+}
+
+static void IdleClocks(BYTE p, unsigned long n)
+{
+	PinState = (PinState & ~(bmBIT0|bmBIT1|bmBIT4)) | (p & (bmBIT1|bmBIT4));
+	ProgIO_Set_State(PinState);
+	if(n > 0) ProgIO_Clock(n);
+}
+
+/* Run pending read-only shift as far as space allows */
+static void FillShift(WORD room)
+{
+	WORD m = FillBytes;
+
+	if(m > room) m = room;
+#ifndef USE_DIRECT_INBUF
+	if(m > InPacketLen-IN_HEADER) m = InPacketLen-IN_HEADER;
+#endif
+	FillBytes -= m;
+
+#ifdef PROTOCOL_MPSSE
+	if(MsbFirst) {
+		while(m--) OutputByte(Reverse(ProgIO_ShiftInOut(FillByte)));
+	} else
+#endif
+	while(m--) OutputByte(ProgIO_ShiftInOut(FillByte));
+
+#ifndef USE_DIRECT_INBUF
+	SendFullPacket();
+#endif
+}
+
+static void PackTDO(BYTE s)
+{
+	if(s & 1) TdoBits |= TdoMask;
+	TdoMask <<= 1;
+	if(TdoMask == 0) {
+		OutputByte(TdoBits);
+		TdoBits = 0;
+		TdoMask = 1;
+	}
+}
+
+static void FlushTDO(void)
+{
+	if(TdoMask != 1) {
+		OutputByte(TdoBits);
+		TdoBits = 0;
+		TdoMask = 1;
+	}
+}
+
+#ifndef PROTOCOL_MPSSE
+
+static void CompareResult(BYTE r, BYTE e, BYTE k)
+{
+	k &= r ^ e;
+	if(k != 0 && !CompareFail) {
+		CompareFail = TRUE;
+		CompareFailOffset = CompareCount;
+		CompareFailBits = k;
+	}
+	CompareCount++;
+}
+
+/* Do M whole triples of a compare shift, read through the first autopointer */
+static void CompareBlock(WORD m)
+{
+	while(m--) {
+		BYTE r = ProgIO_ShiftInOut(XAUTODAT1);
+		BYTE e = XAUTODAT1;
+		CompareResult(r, e, XAUTODAT1);
+	}
+}
+
+/* Take one byte of a triple split across packets */
+static void CompareByte(BYTE d)
+{
+	switch(ComparePhase) {
+		case 0:
+			CompareTdo = ProgIO_ShiftInOut(d);
+			ComparePhase = 1;
+			break;
+		case 1:
+			CompareExp = d;
+			ComparePhase = 2;
+			break;
+		default:
+			ComparePhase = 0;
+			CompareBytes--;
+			CompareResult(CompareTdo, CompareExp, d);
+			break;
+	}
+}
+
+#endif
+
+#ifdef PROTOCOL_MPSSE
+
+//-----------------------------------------------------------------------------
+// MPSSE command engine (PROTOCOL_MPSSE). With it, the device looks like the
+// first channel of a FT2232C/D to MPSSE hosts such as OpenOCD's ftdi driver:
+// commands arrive on EP2 OUT, replies go out through the usual read-back path
+// with the two FTDI status bytes in front of each packet. ADBUS0..3 are TCK,
+// TDI, TDO and TMS. Supported are
+//
+//   0x10..0x3F     Data shifts: bit 1 selects bits (length byte, 1..8) or
+//                  bytes (16 bit length, 1..65536), bit 3 LSB first, bit 4
+//                  writes TDI, bit 5 reads TDO. TDO is read before the rising
+//                  edge of TCK, or with bit 2 (read on the falling edge) at
+//                  sample delay 1 of the fast kernels, right before it. TDI
+//                  changes while TCK is low and is valid on both edges, so
+//                  bit 0 makes no difference.
+//   0x4A/0x4B, 0x6A/0x6B/0x6E/0x6F
+//                  TMS shifts of 1..7 bits, data bit 7 is held on TDI. Bit 5
+//                  reads TDO.
+//   0x80..0x83     Set/read ADBUS and ACBUS. Only TCK, TDI, TMS and TDO are
+//                  real pins, ACBUS just keeps its value.
+//   0x86, 0x8A/0x8B Clock divisor, master clock 60 or 12 MHz. The fastest
+//                  TCK speed that doesn't exceed the requested one is set.
+//   0x87           Send immediate: commit the open read-back packet.
+//   0x8E, 0x8F     Clock 1..8 bits or 8..524288 bits without data.
+//   0x96, 0x97     Adaptive clocking on/off.
+//   0x84/0x85, 0x8C/0x8D, 0x9E  (loopback, 3 phase clocking, drive zero)
+//                  are accepted but ignored.
+//
+// Anything else is answered with 0xFA and the opcode, like FTDI chips do.
+// Bit reads return the bits as the MPSSE does: LSB first, the last bit is
+// in bit 7, MSB first in bit 0.
+
+/* TCK in kHz of hw_basic speeds 0 and 1, 2..255 run at 2 MHz/(speed+3) */
+#define MPSSE_KHZ_SPEED0 1300
+#define MPSSE_KHZ_SPEED1 857
+
+static void MpsseSetClock(void)
+{
+	WORD khz = (MpsseDiv5 ? 6000UL : 30000UL) / (MpsseDivisor + 1UL);
+	WORD s;
+
+	if(khz >= MPSSE_KHZ_SPEED0) s = 0;
+	else if(khz >= MPSSE_KHZ_SPEED1) s = 1;
+	else if(khz < 8) s = 255;
+	else {
+		s = (2000 + khz - 1) / khz - 3;
+		if(s < 2) s = 2;
+		if(s > 255) s = 255;
+	}
+
+	TckSpeed = ProgIO_SetSpeed(s);
+}
+
+static BYTE MpsseArgBytes(BYTE op)
+{
+	if(!(op & 0x80)) {
+		if(op & 0x40) return 2;                    /* TMS: length, data */
+		if(op & 0x02) return (op & 0x10) ? 2 : 1;  /* bits: length, data */
+		return 2;                                  /* bytes: length */
+	}
+
+	switch(op) {
+		case 0x80: case 0x82: case 0x86: case 0x8F: case 0x9E: return 2;
+		case 0x8E: return 1;
+		default:   return 0;
+	}
+}
+
+static void MpsseBadCommand(BYTE op)
+{
+	OutputByte(0xFA);
+	OutputByte(op);
+}
+
+static void MpsseShift(BYTE op)
+{
+	BYTE n = (ExtArgs[0] & 7) + 1;
+	BYTE d, r;
+
+	if((op & 0x70) == 0 || ((op & 0x40) && (op & 0x12) != 0x02)) {
+		MpsseBadCommand(op);
+		return;
+	}
+
+	ProgIO_SetSampleDelay((op & 0x04) ? 1 : 0);
+
+	if(op & 0x40) { /* TMS, LSB first */
+		d = ExtArgs[1];
+		PinState = (PinState & ~(bmBIT0|bmBIT4)) | ((d & 0x80) ? bmBIT4 : 0);
+		if(op & 0x20) {
+			r = ShiftBits((d & 0x80) ? 0xFF : 0x00, d, n);
+			OutputByte(r << (8 - n));
+		} else {
+			ExtRead = FALSE;
+			ShiftTMS((n - 1) | (PinState & bmBIT4), d);
+		}
+		return;
+	}
+
+	MsbFirst = (op & 0x08) ? FALSE : TRUE;
+
+	if(op & 0x02) { /* bits */
+		d = (op & 0x10) ? ExtArgs[1] : ((PinState & bmBIT4) ? 0xFF : 0x00);
+		if(MsbFirst) d = Reverse(d);
+		r = ShiftBits(d, (PinState & bmBIT1) ? 0xFF : 0x00, n);
+		if(op & 0x20) OutputByte(MsbFirst ? (Reverse(r) >> (8 - n)) : (r << (8 - n)));
+		return;
+	}
+
+	/* bytes, 1..65536 */
+	if(op & 0x10) {
+		WriteOnly = (op & 0x20) ? FALSE : TRUE;
+		ClockBytes = ExtArgs[0] | (ExtArgs[1] << 8);
+		if(ClockBytes == 0xFFFF) ExtState = EXT_TAIL;
+		else ClockBytes++;
+	} else {
+		FillByte = (PinState & bmBIT4) ? 0xFF : 0x00;
+		FillBytes = ExtArgs[0] | (ExtArgs[1] << 8);
+		if(FillBytes == 0xFFFF) { /* the first one now */
+			d = ProgIO_ShiftInOut(FillByte);
+			OutputByte(MsbFirst ? Reverse(d) : d);
+		} else {
+			FillBytes++;
+		}
+	}
+}
+
+/* Returns TRUE if it committed the open read-back packet */
+static BOOL MpsseExecute(void)
+{
+	BYTE op = ExtOpcode;
+
+	ExtState = EXT_IDLE;
+
+	if(!(op & 0x80)) {
+		MpsseShift(op);
+		return FALSE;
+	}
+
+	switch(op) {
+		case 0x80: /* set ADBUS */
+			MpsseLow = ExtArgs[0];
+			PinState = (PinState & ~(bmBIT0|bmBIT1|bmBIT4))
+				| ((MpsseLow & bmBIT0) ? bmBIT0 : 0)
+				| ((MpsseLow & bmBIT3) ? bmBIT1 : 0)
+				| ((MpsseLow & bmBIT1) ? bmBIT4 : 0);
+			ProgIO_Set_State(PinState);
+			break;
+		case 0x81: /* read ADBUS */
+			OutputByte((MpsseLow & ~bmBIT2) | ((ProgIO_Set_Get_State(PinState) & 1) ? bmBIT2 : 0));
+			break;
+		case 0x82: /* set ACBUS */
+			MpsseHigh = ExtArgs[0];
+			break;
+		case 0x83: /* read ACBUS */
+			OutputByte(MpsseHigh);
+			break;
+		case 0x86: /* clock divisor */
+			MpsseDivisor = ExtArgs[0] | (ExtArgs[1] << 8);
+			MpsseSetClock();
+			break;
+		case 0x87: /* send immediate */
+#ifdef USE_DIRECT_INBUF
+			if(InCount > 0) {
+				InPacketCommit();
+				return TRUE;
+			}
+#else
+			FlushDue = TRUE;
+#endif
+			break;
+		case 0x8A: /* master clock 60 MHz */
+		case 0x8B: /* master clock 12 MHz */
+			MpsseDiv5 = (op == 0x8B) ? TRUE : FALSE;
+			MpsseSetClock();
+			break;
+		case 0x8E: /* clock bits */
+			ProgIO_Clock((ExtArgs[0] & 7) + 1);
+			break;
+		case 0x8F: /* clock bytes */
+			ProgIO_Clock(((ExtArgs[0] | (ExtArgs[1] << 8)) + 1UL) * 8);
+			break;
+		case 0x96: /* adaptive clocking */
+		case 0x97:
+			ProgIO_SetAdaptive((op == 0x96) ? 1 : 0);
+			break;
+		case 0x84: case 0x85: case 0x8C: case 0x8D: case 0x9E:
+			break;
+		default:
+			MpsseBadCommand(op);
+			break;
+	}
+	return FALSE;
+}
+
+/* Returns TRUE if the read-back packet was committed, see MpsseExecute */
+static BOOL MpsseCommandByte(BYTE d)
+{
+	if(ExtState == EXT_TAIL) {
+		/* Last byte of a 65536 byte shift */
+		ExtState = EXT_IDLE;
+		if(MsbFirst) d = Reverse(d);
+		if(WriteOnly) {
+			ProgIO_ShiftOut(d);
+		} else {
+			d = ProgIO_ShiftInOut(d);
+			OutputByte(MsbFirst ? Reverse(d) : d);
+		}
+		return FALSE;
+	}
+
+	if(ExtState == EXT_IDLE) {
+		ExtOpcode = d;
+		ExtArgCount = 0;
+		ExtState = EXT_ARGS;
+	} else {
+		ExtArgs[ExtArgCount++] = d;
+	}
+
+	if(ExtArgCount == MpsseArgBytes(ExtOpcode)) return MpsseExecute();
+	return FALSE;
+}
+
+#else /* PROTOCOL_MPSSE */
+
+static BYTE ExtArgBytes(BYTE opcode)
+{
+	switch(opcode) {
+		case XCMD_LONG_SHIFT: return 2;
+		case XCMD_BIT_SHIFT:  return 2;
+		case XCMD_TMS:        return 2;
+		case XCMD_CLOCK:      return 4;
+		case XCMD_READ_FILL:  return 3;
+		case XCMD_COMPARE:    return 2;
+		default:              return 0;
+	}
+}
+
+static void ExtExecute(void)
+{
+	ExtState = EXT_IDLE;
+
+	switch(ExtOpcode) {
+		case XCMD_LONG_SHIFT:
+			WriteOnly = !ExtRead;
+			ClockBytes = ExtArgs[0] | (ExtArgs[1] << 8);
+			break;
+		case XCMD_BIT_SHIFT: {
+				BYTE n = (ExtArgs[0] & 7) + 1;
+				BYTE tms = (ExtArgs[0] & bmBIT3) ? (1 << (n-1)) : 0;
+				BYTE r = ShiftBits(ExtArgs[1], tms, n);
+				if(ExtRead) OutputByte(r);
+				break;
+			}
+		case XCMD_TMS:
+			ShiftTMS(ExtArgs[0], ExtArgs[1]);
+			break;
+		case XCMD_CLOCK:
+			IdleClocks(ExtArgs[0], ExtArgs[1]
+				| ((unsigned long)ExtArgs[2] << 8)
+				| ((unsigned long)ExtArgs[3] << 16));
+			break;
+		case XCMD_READ_FILL:
+			FillBytes = ExtArgs[0] | (ExtArgs[1] << 8);
+			FillByte = ExtArgs[2];
+			break;
+		case XCMD_FLUSH_TDO:
+			FlushTDO();
+			break;
+		case XCMD_COMPARE:
+			CompareBytes = ExtArgs[0] | (ExtArgs[1] << 8);
+			ComparePhase = 0;
+			break;
+		case XCMD_CMP_STATUS:
+			if(ExtRead) OutputByte(CompareFail ? 1 : 0);
+			else CompareClear();
+			break;
+		default: /* Unknown opcodes are ignored */
+			break;
+	}
+}
+
+static void ExtCommandByte(BYTE d)
+{
+	if(ExtState == EXT_OPCODE) {
+		ExtOpcode = d;
+		ExtArgCount = 0;
+		ExtState = EXT_ARGS;
+	} else {
+		ExtArgs[ExtArgCount++] = d;
+	}
+
+	if(ExtArgCount == ExtArgBytes(ExtOpcode)) ExtExecute();
+}
+
+#endif /* PROTOCOL_MPSSE */
+
+#ifdef USE_XSVF_PLAYER
+
+//-----------------------------------------------------------------------------
+// XSVF player. Vendor request 0x9A with wIndexL = 1 hands the EP2 stream
+// over to it: from then on, the bytes are taken as an XSVF file instead of
+// USB-Blaster commands, until XCOMPLETE. The TAP is reset first and then
+// followed through all state changes, TDO is compared on the device, and
+// nothing is returned through the read-back path. The host polls 0x9A
+// with wIndexL = 0 for the status:
+//
+//   0  0 idle, 1 running, 2 complete, 3 failed
+//   1  error: 2 TDO mismatch, 4 unknown command, 5 bad TAP state,
+//      6 vector too long, 7 stopped by the host
+//   2  offset of the last (or failing) command in the stream, 32 bit LE
+//   6  its opcode
+//   7  the TAP state, numbered like in XSTATE
+//
+// After a failure, the rest of the stream is dropped until the host sends
+// 0x9A with wIndexL = 2, which also stops a running player. Bytes that are
+// queued after that are USB-Blaster commands again, so hosts should purge
+// (FTDI reset) after stopping within a file.
+//
+// Commands are collected until complete, then run. Vectors of up to
+// XSVF_MAX_BYTES are supported, XSETSDRMASKS and XSDRINC are not. Waits
+// run TCK in Run-Test/Idle for at least as many cycles as microseconds,
+// then wait the time itself. Setup packets aren't served meanwhile, so
+// control transfer timeouts must cover the longest wait in a file.
+//-----------------------------------------------------------------------------
+
+/* Next TAP state for TMS = 0 and 1 */
+static const BYTE TapNext[32] = {
+	 1,  0,   1,  2,   3,  9,   4,  5,  /* Reset, Idle, Select-DR, Capture-DR */
+	 4,  5,   6,  8,   6,  7,   4,  8,  /* Shift-DR, Exit1-DR, Pause-DR, Exit2-DR */
+	 1,  2,  10,  0,  11, 12,  11, 12,  /* Update-DR, Select-IR, Capture-IR, Shift-IR */
+	13, 15,  13, 14,  11, 15,   1,  2   /* Exit1-IR, Pause-IR, Exit2-IR, Update-IR */
+};
+
+static void XsvfFail(BYTE e)
+{
+	if(XsvfStatus != XSVF_RUNNING) return;
+	XsvfStatus = XSVF_FAILED;
+	XsvfError = e;
+}
+
+/* Clock TMS to get to state T on a shortest path. Reset always takes five
+ * cycles with TMS high, so it works from an unknown state. */
+static void XsvfGoto(BYTE t)
+{
+	BYTE s, b, tms = 0, n = 0, head = 0, tail = 0;
+
+	if(t == TAP_RESET) {
+		tms = 0x1F;
+		n = 5;
+	} else if(t != XsvfTap) {
+		/* Breadth first search, XsvfPrev holds the state before and the
+		 * TMS value (bit 7) to get there */
+		for(s = 0; s < 16; s++) XsvfPrev[s] = 0xFF;
+		XsvfPrev[XsvfTap] = XsvfTap;
+		XsvfQueue[tail++] = XsvfTap;
+
+		while(XsvfPrev[t] == 0xFF) {
+			s = XsvfQueue[head++];
+			for(b = 0; b < 2; b++) {
+				BYTE x = TapNext[2*s + b];
+				if(XsvfPrev[x] == 0xFF) {
+					XsvfPrev[x] = s | (b << 7);
+					XsvfQueue[tail++] = x;
+				}
+			}
+		}
+
+		for(s = t; s != XsvfTap; s = XsvfPrev[s] & 0x0F) {
+			tms = (tms << 1) | (XsvfPrev[s] >> 7);
+			n++;
+		}
+	}
+
+	if(n > 0) {
+		/* TCK low first, or the first TMS bit gets no rising edge */
+		PinState &= ~bmBIT0;
+		ProgIO_Set_State(PinState);
+		ProgIO_ShiftTMS(tms, n);
+
+		if(tms & (1 << (n-1)))
+			PinState |= bmBIT1;
+		else
+			PinState &= ~bmBIT1;
+	}
+
+	XsvfTap = t;
+}
+
+static void XsvfWait(unsigned long us)
+{
+	if(us == 0) return;
+
+	ProgIO_Clock((us < 0x1000000) ? us : 0x1000000);
+
+	while(us >= 1000) {
+		mdelay(1);
+		us -= 1000;
+	}
+	while(us >= 250) {
+		udelay(250);
+		us -= 250;
+	}
+	if(us > 0) udelay(us);
+}
+
+/* Shift BITS bits of XsvfTdi in the current Shift-DR/IR state. The vector
+ * is MSB first, so its last byte goes out first, LSB first. Returns whether
+ * TDO differs from XsvfTdoExp where XsvfTdoMask has ones. */
+static BOOL XsvfShiftBits(WORD bits, BYTE flags)
+{
+	WORD i = (bits + 7) >> 3;
+	BYTE d, k, diff = 0;
 
-#define USE_MOD256_OUTBUFFER 1
+	if(bits == 0) return FALSE;
 
-//-----------------------------------------------------------------------------
-typedef bit BOOL;
-#define FALSE 0
-#define TRUE  1
-static BOOL Running;
-static BOOL WriteOnly;
+	while(--i > 0) {
+		d = ProgIO_ShiftInOut(XsvfTdi[i]);
+		diff |= (d ^ XsvfTdoExp[i]) & XsvfTdoMask[i];
+	}
 
-static BYTE ClockBytes;
-static WORD Pending;
+	/* The first byte holds the last 1..8 bits */
+	k = ((bits - 1) & 7) + 1;
+	d = ShiftBits(XsvfTdi[0], (flags & XSVF_EXIT) ? (1 << (k-1)) : 0, k);
+	diff |= (d ^ XsvfTdoExp[0]) & XsvfTdoMask[0] & (0xFF >> (8-k));
 
-#ifdef USE_MOD256_OUTBUFFER
-static BYTE FirstDataInOutBuffer;
-static BYTE FirstFreeInOutBuffer;
-#else
-static WORD FirstDataInOutBuffer;
-static WORD FirstFreeInOutBuffer;
-#endif
+	if(flags & XSVF_EXIT) XsvfTap++; /* Exit1 follows Shift */
 
-#ifdef USE_MOD256_OUTBUFFER
-/* Size of output buffer must be exactly 256 */
-#define OUTBUFFER_LEN 0x100
-/* Output buffer must begin at some address with lower 8 bits all zero */
-xdata at 0xE000 BYTE OutBuffer[OUTBUFFER_LEN];
-#else
-#define OUTBUFFER_LEN 0x200
-static xdata BYTE OutBuffer[OUTBUFFER_LEN];
-#endif
+	return (flags & XSVF_CMP) && diff != 0;
+}
 
-//-----------------------------------------------------------------------------
-void usb_jtag_init(void)
+/* Shift a vector like the Xilinx reference player: with XSVF_RUNTEST, wait
+ * XsvfRunTest in Run-Test/Idle afterwards and retry a TDO mismatch up to
+ * XsvfRepeat times through Pause-DR, waiting 25% longer each time */
+static void XsvfShift(BYTE shift, WORD bits, BYTE flags)
 {
-	WORD tmp;
+	unsigned long wait = (flags & XSVF_RUNTEST) ? XsvfRunTest : 0;
+	BYTE repeat = (flags & XSVF_RUNTEST) ? XsvfRepeat : 0;
+	BYTE end = (shift == TAP_SHIFTIR) ? XsvfEndIR : XsvfEndDR;
+	BOOL fail;
 
-	Running = FALSE;
-	ClockBytes = 0;
-	Pending = 0;
-	WriteOnly = TRUE;
-	FirstDataInOutBuffer = 0;
-	FirstFreeInOutBuffer = 0;
+	for(;;) {
+		XsvfGoto(shift);
+		fail = XsvfShiftBits(bits, flags);
+		if(!(flags & XSVF_EXIT)) break;
 
-	ProgIO_Init();
+		if(fail && repeat > 0) {
+			XsvfGoto(TAP_PAUSEDR);
+			XsvfGoto(TAP_SHIFTDR);
+			wait += wait >> 2;
+		} else {
+			XsvfGoto(end);
+		}
 
-	// Make Timer2 reload at 100 Hz to trigger Keepalive packets
-	tmp = 65536 - ( 48000000 / 12 / 100 );
-	RCAP2H = tmp >> 8;
-	RCAP2L = tmp & 0xFF;
-	CKCON = 0; // Default Clock
-	T2CON = 0x04; // Auto-reload mode using internal clock, no baud clock.
+		if(wait > 0) {
+			XsvfGoto(TAP_IDLE);
+			XsvfWait(wait);
+		}
 
-	// Enable Autopointer
-	EXTACC = 1; // Enable
-	APTR1FZ = 1; // Don't freeze
-	APTR2FZ = 1; // Don't freeze
+		if(!fail || repeat-- == 0) break;
+	}
 
-	// define endpoint configuration
+	if(fail) XsvfFail(XSVF_ERROR_TDOMISMATCH);
+}
 
-	REVCTL = 3; SYNCDELAY; // Allow FW access to FIFO buffer
-	FIFORESET = 0x80; SYNCDELAY; // From now on, NAK all, reset all FIFOS
-	FIFORESET  = 0x02; SYNCDELAY; // Reset FIFO 2
-	FIFORESET  = 0x04; SYNCDELAY; // Reset FIFO 4
-	FIFORESET  = 0x06; SYNCDELAY; // Reset FIFO 6
-	FIFORESET  = 0x08; SYNCDELAY; // Reset FIFO 8
-	FIFORESET  = 0x00; SYNCDELAY; // Restore normal behaviour
+/* 32 bit argument, MSB first */
+static unsigned long XsvfLong(xdata BYTE *p)
+{
+	return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16)
+		| ((WORD)p[2] << 8) | p[3];
+}
 
-	EP1OUTCFG  = 0xA0; SYNCDELAY; // Endpoint 1 Type Bulk
-	EP1INCFG   = 0xA0; SYNCDELAY; // Endpoint 1 Type Bulk
+static BOOL XsvfArgField(BYTE n)
+{
+	XsvfDest = XsvfArgs;
+	XsvfCount = n;
+	return TRUE;
+}
 
-	EP2FIFOCFG = 0x00; SYNCDELAY; // Endpoint 2
-	EP2CFG     = 0xA2; SYNCDELAY; // Endpoint 2 Valid, Out, Type Bulk, Double buffered
+static BOOL XsvfVectorField(xdata BYTE *v, WORD bits)
+{
+	WORD n = (bits >> 3) + ((bits & 7) ? 1 : 0);
 
-	EP4FIFOCFG = 0x00; SYNCDELAY; // Endpoint 4 not used
-	EP4CFG     = 0xA0; SYNCDELAY; // Endpoint 4 not used
+	if(n > XSVF_MAX_BYTES) {
+		XsvfFail(XSVF_ERROR_DATAOVERFLOW);
+		return FALSE;
+	}
+	XsvfDest = v;
+	XsvfCount = n;
+	return TRUE;
+}
 
-	REVCTL = 0; SYNCDELAY; // Reset FW access to FIFO buffer, enable auto-arming when AUTOOUT is switched to 1
+/* Set up where the next bytes of the current command go. Returns FALSE
+ * once it is complete, or if it can't be run. */
+static BOOL XsvfField(void)
+{
+	BYTE ph = XsvfPhase++;
 
-	EP6CFG     = 0xA2; SYNCDELAY; // Out endpoint, Bulk, Double buffering
-	EP6FIFOCFG = 0x00; SYNCDELAY; // Firmware has to see a rising edge on auto bit to enable auto arming
-	EP6FIFOCFG = bmAUTOOUT | bmWORDWIDE; SYNCDELAY; // Endpoint 6 used for user communicationn, auto commitment, 16 bits data bus
+	switch(XsvfOpcode) {
+		case XCOMPLETE:
+			return FALSE;
+		case XTDOMASK:
+			return ph == 0 && XsvfVectorField(XsvfTdoMask, XsvfSdrBits);
+		case XSIR:
+			if(ph == 0) return XsvfArgField(1);
+			return ph == 1 && XsvfVectorField(XsvfTdi, XsvfArgs[0]);
+		case XSIR2:
+			if(ph == 0) return XsvfArgField(2);
+			return ph == 1 && XsvfVectorField(XsvfTdi, (XsvfArgs[0] << 8) | XsvfArgs[1]);
+		case XSDR:
+		case XSDRB:
+		case XSDRC:
+		case XSDRE:
+			return ph == 0 && XsvfVectorField(XsvfTdi, XsvfSdrBits);
+		case XSDRTDO:
+		case XSDRTDOB:
+		case XSDRTDOC:
+		case XSDRTDOE:
+			if(ph == 0) return XsvfVectorField(XsvfTdi, XsvfSdrBits);
+			return ph == 1 && XsvfVectorField(XsvfTdoExp, XsvfSdrBits);
+		case XRUNTEST:
+		case XSDRSIZE:
+			return ph == 0 && XsvfArgField(4);
+		case XREPEAT:
+		case XSTATE:
+		case XENDIR:
+		case XENDDR:
+			return ph == 0 && XsvfArgField(1);
+		case XWAIT:
+			return ph == 0 && XsvfArgField(6);
+		case XCOMMENT:
+			/* Text up to a zero byte, see XsvfByte() */
+			XsvfCount = 1;
+			return ph == 0;
+		default:
+			XsvfFail(XSVF_ERROR_ILLEGALCMD);
+			return FALSE;
+	}
+}
 
-	EP8CFG     = 0xE0; SYNCDELAY; // In endpoint, Bulk
-	EP8FIFOCFG = 0x00; SYNCDELAY; // Firmware has to see a rising edge on auto bit to enable auto arming
-	EP8FIFOCFG = bmAUTOIN  | bmWORDWIDE; SYNCDELAY; // Endpoint 8 used for user communication, auto commitment, 16 bits data bus
+static void XsvfExecute(void)
+{
+	switch(XsvfOpcode) {
+		case XCOMPLETE:
+			XsvfStatus = XSVF_COMPLETE;
+			XsvfActive = FALSE;
+			break;
+		case XSIR:
+			XsvfShift(TAP_SHIFTIR, XsvfArgs[0], XSVF_EXIT|XSVF_RUNTEST);
+			break;
+		case XSIR2:
+			XsvfShift(TAP_SHIFTIR, (XsvfArgs[0] << 8) | XsvfArgs[1], XSVF_EXIT|XSVF_RUNTEST);
+			break;
+		case XSDR:
+		case XSDRTDO:
+			XsvfShift(TAP_SHIFTDR, XsvfSdrBits, XSVF_EXIT|XSVF_CMP|XSVF_RUNTEST);
+			break;
+		case XSDRB:
+		case XSDRC:
+			XsvfShift(TAP_SHIFTDR, XsvfSdrBits, 0);
+			break;
+		case XSDRE:
+			XsvfShift(TAP_SHIFTDR, XsvfSdrBits, XSVF_EXIT);
+			break;
+		case XSDRTDOB:
+		case XSDRTDOC:
+			XsvfShift(TAP_SHIFTDR, XsvfSdrBits, XSVF_CMP);
+			break;
+		case XSDRTDOE:
+			XsvfShift(TAP_SHIFTDR, XsvfSdrBits, XSVF_EXIT|XSVF_CMP);
+			break;
+		case XRUNTEST:
+			XsvfRunTest = XsvfLong(XsvfArgs);
+			break;
+		case XREPEAT:
+			XsvfRepeat = XsvfArgs[0];
+			break;
+		case XSDRSIZE:
+			if(XsvfLong(XsvfArgs) > XSVF_MAX_BYTES * 8)
+				XsvfFail(XSVF_ERROR_DATAOVERFLOW);
+			else
+				XsvfSdrBits = XsvfLong(XsvfArgs);
+			break;
+		case XSTATE:
+			if(XsvfArgs[0] > 15) XsvfFail(XSVF_ERROR_ILLEGALSTATE);
+			else XsvfGoto(XsvfArgs[0]);
+			break;
+		case XENDIR:
+		case XENDDR:
+			if(XsvfArgs[0] > 1) {
+				XsvfFail(XSVF_ERROR_ILLEGALSTATE);
+			} else if(XsvfOpcode == XENDIR) {
+				XsvfEndIR = XsvfArgs[0] ? TAP_PAUSEIR : TAP_IDLE;
+			} else {
+				XsvfEndDR = XsvfArgs[0] ? TAP_PAUSEDR : TAP_IDLE;
+			}
+			break;
+		case XWAIT:
+			if(XsvfArgs[0] > 15 || XsvfArgs[1] > 15) {
+				XsvfFail(XSVF_ERROR_ILLEGALSTATE);
+			} else {
+				XsvfGoto(XsvfArgs[0]);
+				XsvfWait(XsvfLong(XsvfArgs + 2));
+				XsvfGoto(XsvfArgs[1]);
+			}
+			break;
+		default: /* XTDOMASK and XCOMMENT are done with their data */
+			break;
+	}
+}
 
-	EP8AUTOINLENH = 0x00; SYNCDELAY; // Size in bytes of the IN data automatically commited (64 bytes here, but changed dynamically depending on the connection)
-	EP8AUTOINLENL = 0x40; SYNCDELAY; // Can use signal PKTEND if you want to commit a shorter packet
+/* Take one byte of the XSVF stream */
+static void XsvfByte(BYTE d)
+{
+	XsvfOffset++;
+	if(XsvfStatus != XSVF_RUNNING) return; /* drop the rest of a failed file */
 
-	// Out endpoints do not come up armed
-	// Since the defaults are double buffered we must write dummy byte counts twice
-	EP2BCL = 0x80; SYNCDELAY; // Arm EP2OUT by writing byte count w/skip
-	EP4BCL = 0x80; SYNCDELAY;
-	EP2BCL = 0x80; SYNCDELAY; // Arm EP4OUT by writing byte count w/skip
-	EP4BCL = 0x80; SYNCDELAY;
+	if(!XsvfInCommand) {
+		XsvfOpcode = d;
+		XsvfCmdOffset = XsvfOffset - 1;
+		XsvfPhase = 0;
+		XsvfInCommand = TRUE;
+	} else if(XsvfOpcode == XCOMMENT) {
+		if(d != 0) return;
+	} else {
+		*XsvfDest++ = d;
+		if(--XsvfCount > 0) return;
+	}
 
-	// JTAG from FX2 enabled by default
-	IOC |= (1 << 7);
+	/* Skip empty fields, run the command once all are there */
+	while(XsvfField()) if(XsvfCount > 0) return;
 
-	// Put the system in high speed by default (REM: USB-Blaster is in full speed)
-	// This can be changed by vendor commands
-	CT1 &= ~0x02;
-	// Put the FIFO in sync mode
-	IFCONFIG &= ~bmASYNC;
+	XsvfInCommand = FALSE;
+	if(XsvfStatus == XSVF_RUNNING) XsvfExecute();
 }
 
-void OutputByte(BYTE d)
+static void XsvfStart(void)
 {
-#ifdef USE_MOD256_OUTBUFFER
-	OutBuffer[FirstFreeInOutBuffer] = d;
-	FirstFreeInOutBuffer = ( FirstFreeInOutBuffer + 1 ) & 0xFF;
-#else
-	OutBuffer[FirstFreeInOutBuffer++] = d;
-	if(FirstFreeInOutBuffer >= OUTBUFFER_LEN) FirstFreeInOutBuffer = 0;
-#endif
-	Pending++;
+	WORD i;
+
+	for(i = 0; i < XSVF_MAX_BYTES; i++) {
+		XsvfTdoExp[i] = 0;
+		XsvfTdoMask[i] = 0;
+	}
+
+	XsvfActive = TRUE;
+	XsvfInCommand = FALSE;
+	XsvfStatus = XSVF_RUNNING;
+	XsvfError = XSVF_ERROR_NONE;
+	XsvfOpcode = XCOMPLETE;
+	XsvfOffset = 0;
+	XsvfCmdOffset = 0;
+	XsvfSdrBits = 0;
+	XsvfRunTest = 0;
+	XsvfRepeat = XSVF_DEF_REPEAT;
+	XsvfEndIR = TAP_IDLE;
+	XsvfEndDR = TAP_IDLE;
+
+	Running = TRUE;
+	XsvfGoto(TAP_RESET);
+}
+
+static void XsvfStop(void)
+{
+	XsvfFail(XSVF_ERROR_ABORTED);
+	XsvfActive = FALSE;
 }
 
+#endif /* USE_XSVF_PLAYER */
+
 //-----------------------------------------------------------------------------
 // usb_jtag_activity does most of the work. It now happens to behave just like
 // the combination of FT245BM and Altera-programmed EPM7064 CPLD in Altera's
@@ -211,92 +1985,331 @@ void usb_jtag_activity(void)
 {
 	if(!Running) return;
 
-	if(!(EP1INCS & bmEPBUSY)) {
-		if(Pending > 0) {
-			BYTE o, n;
-
-			AUTOPTRH2 = MSB( EP1INBUF );
-			AUTOPTRL2 = LSB( EP1INBUF );
-
-			XAUTODAT2 = 0x31;
-			XAUTODAT2 = 0x60;
+	LatencyTick();
 
-			if(Pending > 0x3E) { n = 0x3E; Pending -= n; }
-			else { n = Pending; Pending = 0; };
+	/* Don't keep packed TDO samples back while the host has nothing queued */
+	if(TdoMask != 1 && (FlushDue || (Extensions & EXT_ADAPTIVE)) && HostWaiting()
+			&& OutputSpace() > 0)
+		FlushTDO();
 
-			o = n;
-
-#ifdef USE_MOD256_OUTBUFFER
-			APTR1H = MSB( OutBuffer );
-			APTR1L = FirstDataInOutBuffer;
-			while(n--) {
-				XAUTODAT2 = XAUTODAT1;
-				APTR1H = MSB( OutBuffer ); // Stay within 256-Byte-Buffer
-			}
-			FirstDataInOutBuffer = APTR1L;
+#ifdef USE_DIRECT_INBUF
+	if(InCount > 0) {
+		/* An open packet implies the IN buffer isn't busy, send what we have */
+		if(!HoldPartial()) InPacketCommit();
+	} else {
+		SelectReadback();
+		if(!InBufferBusy()) Keepalive();
+	}
 #else
-			APTR1H = MSB( &(OutBuffer[FirstDataInOutBuffer]) );
-			APTR1L = LSB( &(OutBuffer[FirstDataInOutBuffer]) );
-			while(n--) {
-				XAUTODAT2 = XAUTODAT1;
-				if(++FirstDataInOutBuffer >= OUTBUFFER_LEN) {
-					FirstDataInOutBuffer = 0;
-					APTR1H = MSB( OutBuffer );
-					APTR1L = LSB( OutBuffer );
-				}
-			}
-#endif
-			SYNCDELAY;
-			EP1INBC = 2 + o;
-			TF2 = 1; // Make sure there will be a short transfer soon
-		} else if(TF2) {
-			EP1INBUF[0] = 0x31;
-			EP1INBUF[1] = 0x60;
-			SYNCDELAY;
-			EP1INBC = 2;
-			TF2 = 0;
+	SelectReadback();
+
+	if(!InBufferBusy()) {
+		if(Pending > 0) {
+			if(Pending >= InPacketLen-IN_HEADER || !HoldPartial()) SendPending();
+		} else {
+			Keepalive();
 		}
 	}
+#endif
+
+	if(FillBytes > 0) {
+		FillShift(OutputSpace());
+		if(FillBytes > 0) return;
+	}
+
+	if(!(EP2468STAT & bmCMD_EMPTY)) {
+		WORD room = 0;
+		WORD i, n = CMD_BCL|CMD_BCH<<8;
 
-	if(!(EP2468STAT & bmEP2EMPTY) && (Pending < OUTBUFFER_LEN-0x3F)) {
-		WORD i, n = EP2BCL|EP2BCH<<8;
+		/* Continue where the previous call stopped. Only as much is done
+		 * as there is space for the output; if it runs out, the parser
+		 * state is kept and the packet is resumed on a later call. */
 
-		APTR1H = MSB( EP2FIFOBUF );
-		APTR1L = LSB( EP2FIFOBUF );
+		i = EP2Offset;
+		APTR1H = MSB( &(CMD_FIFOBUF[i]) );
+		APTR1L = LSB( &(CMD_FIFOBUF[i]) );
 
-		for(i = 0; i < n;) {
-			if(ClockBytes > 0) {
+		while(i < n) {
+#ifdef USE_XSVF_PLAYER
+			if(XsvfActive) {
+				/* The XSVF player takes the stream, there's no output */
+				XsvfByte(XAUTODAT1);
+				i++;
+			} else
+#endif
+			if(FillBytes > 0) {
+				/* A read-only shift doesn't consume any bytes from EP2 */
+				NEED_ROOM();
+				FillShift(room);
+				room = 0;
+			} else if(ClockBytes > 0) {
 				WORD m;
 
 				m = n-i;
 				if(ClockBytes < m) m = ClockBytes;
-				ClockBytes -= m;
-				i += m;
-
-				/* Shift out 8 bits from d */
-				if(WriteOnly) /* Shift out 8 bits from d */
-					while(m--) ProgIO_ShiftOut(XAUTODAT1);
-				else /* Shift in 8 bits at the other end  */
-					while(m--) OutputByte(ProgIO_ShiftInOut(XAUTODAT1));
+
+				if(WriteOnly) { /* Shift out 8 bits from d */
+					ClockBytes -= m;
+					i += m;
+					ShiftOutBlock(m);
+				} else { /* Shift in 8 bits at the other end  */
+					NEED_ROOM();
+					if(room < m) m = room;
+#ifndef USE_DIRECT_INBUF
+					/* Not more than one IN packet at once, so full packets
+					 * can go out while the shift continues. (Without the
+					 * OutBuffer, they're committed as soon as they're full.) */
+					if(m > InPacketLen-IN_HEADER) m = InPacketLen-IN_HEADER;
+#endif
+					room -= m;
+					ClockBytes -= m;
+					i += m;
+					ShiftInOutBlock(m);
+#ifndef USE_DIRECT_INBUF
+					SendFullPacket();
+					room = 0;
+#endif
+				}
+#ifndef PROTOCOL_MPSSE
+			} else if(CompareBytes > 0) {
+				/* Whole triples at once, one split across packets byte
+				 * by byte. There's no output. */
+				WORD m = (n-i) / 3;
+
+				if(ComparePhase != 0 || m == 0) {
+					CompareByte(XAUTODAT1);
+					i++;
+				} else {
+					if(CompareBytes < m) m = CompareBytes;
+					CompareBytes -= m;
+					i += 3*m;
+					CompareBlock(m);
+				}
+#endif
 			} else {
-				BYTE d = XAUTODAT1;
-				WriteOnly = (d & bmBIT6) ? FALSE : TRUE;
-				if(d & bmBIT7) {
-					/* Prepare byte transfer, do nothing else yet */
-					ClockBytes = d & 0x3F;
+#ifdef PROTOCOL_MPSSE
+				/* An MPSSE command byte yields up to two bytes */
+				if(room < 2 && (room = OutputSpace()) < 2) break;
+				room -= 2;
+
+				/* After send immediate, the space has to be checked again:
+				 * writing to a busy IN buffer would wait for the host */
+				if(MpsseCommandByte(XAUTODAT1)) room = 0;
+#else
+				/* Any other command byte yields at most one byte. Only the
+				 * ones that can wait for space: bit banging with bit 6 set,
+				 * the bytes of a read-enabled extended command and the TDO
+				 * flush, so write-only streams go on while the host doesn't
+				 * read. */
+				BYTE d = CMD_FIFOBUF[i];
+
+				if(ExtState != EXT_IDLE
+						? (ExtRead || (ExtState == EXT_OPCODE && d == XCMD_FLUSH_TDO))
+						: (d & (bmBIT7|bmBIT6)) == bmBIT6) {
+					NEED_ROOM();
+					room--;
+				}
+				d = XAUTODAT1; // the same byte, moves the autopointer on
+
+				if(ExtState != EXT_IDLE) {
+					ExtCommandByte(d);
 				} else {
-					if(WriteOnly)
-						ProgIO_Set_State(d);
-					else
-						OutputByte(ProgIO_Set_Get_State(d));
+					WriteOnly = (d & bmBIT6) ? FALSE : TRUE;
+					if(d & bmBIT7) {
+						/* Prepare byte transfer, do nothing else yet */
+						ClockBytes = d & 0x3F;
+						if(ClockBytes == 0 && (Extensions & EXT_COMMANDS)) {
+							/* Extended command follows */
+							ExtRead = !WriteOnly;
+							ExtState = EXT_OPCODE;
+						}
+					} else {
+						PinState = d & ~bmBIT6;
+						if(WriteOnly)
+							ProgIO_Set_State(d);
+						else if(Extensions & EXT_PACKED_TDO)
+							PackTDO(ProgIO_Set_Get_State(d));
+						else
+							OutputByte(ProgIO_Set_Get_State(d));
+					}
 				}
+#endif
 				i++;
 			}
 		}
 
-		SYNCDELAY;
-		EP2BCL = 0x80; // Re-arm endpoint 2
+		if(i < n) {
+			EP2Offset = i;
+		} else {
+			EP2Offset = 0;
+			SYNCDELAY;
+			CMD_BCL = 0x80; // Re-arm the command endpoint
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// FTDI purge. Setup packets are handled from the main loop, so nothing is
+// in progress in usb_jtag_activity() while these run.
+//-----------------------------------------------------------------------------
+
+/* Drop unsent read-back data. A packet already committed to EP1 IN
+ * can't be taken back, the EP4 (EP8 on the Blaster II) IN buffers are
+ * emptied. */
+static void PurgeReadback(void)
+{
+#ifdef USE_DIRECT_INBUF
+	InCount = 0;
+#else
+	Pending = 0;
+	FirstDataInOutBuffer = 0;
+	FirstFreeInOutBuffer = 0;
+#endif
+	TdoBits = 0;
+	TdoMask = 1;
+
+	REVCTL = 3; SYNCDELAY; // Allow FW access to FIFO buffer
+	FIFORESET = 0x80; SYNCDELAY; // NAK all
+	FIFORESET = IN_FIFO; SYNCDELAY; // Reset the read-back FIFO
+	FIFORESET = 0x00; SYNCDELAY; // Restore normal behaviour
+	REVCTL = 0; SYNCDELAY;
+
+	KeepaliveDue = TRUE; // Tell the host quickly that we're alive
+}
+
+/* Drop queued commands, including the rest of a command in progress */
+static void PurgeCommands(void)
+{
+	ClockBytes = 0;
+	FillBytes = 0;
+	CompareBytes = 0;
+	ComparePhase = 0;
+	ExtState = EXT_IDLE;
+	EP2Offset = 0;
+#ifdef USE_XSVF_PLAYER
+	if(XsvfActive) XsvfStop();
+#endif
+
+	REVCTL = 3; SYNCDELAY; // Allow FW access to FIFO buffer
+	FIFORESET = 0x80; SYNCDELAY; // NAK all
+	FIFORESET = CMD_FIFO; SYNCDELAY; // Reset the command FIFO
+	FIFORESET = 0x00; SYNCDELAY; // Restore normal behaviour
+	REVCTL = 0; SYNCDELAY;
+
+	CMD_BCL = 0x80; SYNCDELAY; // Arm both command OUT buffers again
+	CMD_BCL = 0x80; SYNCDELAY;
+}
+
+#endif /* PROTOCOL_XPCU */
+
+//-----------------------------------------------------------------------------
+// TCK speed measurement. Timer2 is borrowed from the latency timer and runs
+// from zero around a block shift of MEASURE_BYTES, which includes the time
+// between bytes. TDI is all ones from EP0BUF, read-back goes to its second
+// half. TMS isn't changed, so the host should keep the TAP in
+// Test-Logic-Reset or Run-Test/Idle while measuring. In Shift-IR, the ones
+// load BYPASS; in Shift-DR, they still overwrite the selected register.
+//-----------------------------------------------------------------------------
+
+/* Returns the TCK frequency in kHz */
+static WORD MeasureTCK(BYTE read)
+{
+	BYTE a1h = APTR1H, a1l = APTR1L;
+	BYTE a2h = AUTOPTRH2, a2l = AUTOPTRL2;
+	WORD ticks;
+	BYTE i;
+
+	for(i = 0; i < MEASURE_BYTES; i++) EP0BUF[i] = 0xFF;
+
+	/* Stopping and reloading Timer2 loses the latency tick in progress,
+	 * the next flush or keepalive comes up to a tick plus the measurement
+	 * late */
+	TR2 = 0;
+	RCAP2H = 0;
+	RCAP2L = 0;
+	TH2 = 0;
+	TL2 = 0;
+	TF2 = 0;
+
+	APTR1H = MSB( EP0BUF );
+	APTR1L = LSB( EP0BUF );
+	AUTOPTRH2 = MSB( &(EP0BUF[32]) );
+	AUTOPTRL2 = LSB( &(EP0BUF[32]) );
+
+	TR2 = 1;
+	if(read) ProgIO_ShiftInOut_Block(MEASURE_BYTES);
+	else ProgIO_ShiftOut_Block(MEASURE_BYTES);
+	TR2 = 0;
+
+	ticks = (TH2 << 8) | TL2;
+	if(TF2 || ticks == 0) ticks = 0xFFFF; // too slow to tell
+
+	RCAP2H = TIMER2_RELOAD >> 8;
+	RCAP2L = TIMER2_RELOAD & 0xFF;
+	TH2 = RCAP2H;
+	TL2 = RCAP2L;
+	TF2 = 0;
+	TR2 = 1;
+
+	APTR1H = a1h;
+	APTR1L = a1l;
+	AUTOPTRH2 = a2h;
+	AUTOPTRL2 = a2l;
+
+	// MEASURE_BYTES*8 cycles in ticks of 0.25 us
+	return (WORD)((MEASURE_BYTES * 8 * 4000UL) / ticks);
+}
+
+//-----------------------------------------------------------------------------
+// TDO sample delay calibration. The host puts the TAPs into Shift-DR with a
+// known number of register bits between TDI and TDO, less than CAL_BYTES*8,
+// e.g. all of them in BYPASS. For each sample delay, a pattern is shifted
+// through twice. The second time, TDO has to return the pattern rotated by
+// the chain length; sampling too early or too late is off by one bit. TMS
+// stays low, so the TAPs are still in Shift-DR afterwards. The delay only
+// matters for the fastest TCK speed, the slower kernels ignore it, so the
+// calibration runs at speed 0 and the speed set before is restored.
+//-----------------------------------------------------------------------------
+
+static const BYTE CalPattern[CAL_BYTES] = {
+	0x4B, 0x1D, 0xE2, 0x70, 0xA5, 0x39, 0xC6, 0x0F
+};
+
+static BYTE CalCheck(BYTE len)
+{
+	BYTE i, j;
+
+	for(i = 0; i < CAL_BYTES; i++) ProgIO_ShiftInOut(CalPattern[i]);
+	for(i = 0; i < CAL_BYTES; i++) EP0BUF[32+i] = ProgIO_ShiftInOut(CalPattern[i]);
+
+	for(i = 0; i < CAL_BYTES*8; i++) {
+		j = (i - len) & (CAL_BYTES*8 - 1);
+		if(((EP0BUF[32 + (i >> 3)] >> (i & 7)) ^ (CalPattern[j >> 3] >> (j & 7))) & 1)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* Selects the latest delay that passes, or 0 if none does. Returns the
+ * delay, the mask of passing delays goes to EP0BUF[1]. */
+static BYTE CalibrateSampleDelay(BYTE len)
+{
+	BYTE d, pass = 0, best = 0;
+
+	ProgIO_SetSpeed(0);
+
+	for(d = 0; d < CAL_DELAYS; d++) {
+		if(ProgIO_SetSampleDelay(d) != d) break;
+		if(CalCheck(len)) {
+			pass |= 1 << d;
+			best = d;
+		}
 	}
+
+	ProgIO_SetSpeed(TckSpeed);
+
+	EP0BUF[1] = pass;
+	return ProgIO_SetSampleDelay(best);
 }
 
 //-----------------------------------------------------------------------------
@@ -306,9 +2319,18 @@ unsigned char app_vendor_cmd(void)
 {
 	// OUT requests. Pretend we handle them all
 	if ((bRequestType & bmRT_DIR_MASK) == bmRT_DIR_OUT){
-		if(bRequest == RQ_GET_STATUS){
+#ifdef PROTOCOL_XPCU
+		if(bRequest == XPCU_REQUEST) XpcuVendorOut();
+#else
+		if(bRequest == SIO_RESET){
+			if(wValueL != SIO_RESET_PURGE_TX) PurgeCommands();
+			if(wValueL != SIO_RESET_PURGE_RX) PurgeReadback();
 			Running = 1;
+		} else if(bRequest == SIO_SET_LATENCY_TIMER){
+			Latency = wValueL ? wValueL : 1;
+			LatencyTicks = 0;
 		};
+#endif
 		return 1;
 	}
 
@@ -366,6 +2388,89 @@ unsigned char app_vendor_cmd(void)
 				EP0BCL = i;
 				break;
 			}
+		case SIO_GET_LATENCY_TIMER:
+			EP0BUF[0] = Latency;
+			EP0BCH = 0; // Arm endpoint
+			EP0BCL = 1;
+			break;
+		case 0x95: // enable protocol extensions, returns those enabled
+			Extensions = wIndexL & EXT_ALL;
+			ExtState = EXT_IDLE;
+			TdoBits = 0;
+			TdoMask = 1;
+			EP0BUF[0] = Extensions;
+			EP0BCH = 0; // Arm endpoint
+			EP0BCL = 1;
+			break;
+		case 0x96: { // set TCK speed (wIndexL), wValueL bit 0: measure it
+				// returns speed set, write and read TCK in kHz (LE, 0 if not measured)
+				WORD w = 0, r = 0;
+				EP0BUF[0] = TckSpeed = ProgIO_SetSpeed(wIndexL);
+				if(wValueL & 1){
+					w = MeasureTCK(FALSE);
+					r = MeasureTCK(TRUE);
+				}
+				EP0BUF[1] = LSB(w);
+				EP0BUF[2] = MSB(w);
+				EP0BUF[3] = LSB(r);
+				EP0BUF[4] = MSB(r);
+				EP0BCH = 0; // Arm endpoint
+				EP0BCL = (wLengthL<5) ? wLengthL : 5;
+				break;
+			}
+		case 0x97: // adaptive clocking on (wIndexL = 1) or off
+			// returns bit 0: on, bit 1: RTCK timeout since the last request
+			EP0BUF[0] = ProgIO_SetAdaptive(wIndexL & 1);
+			EP0BCH = 0; // Arm endpoint
+			EP0BCL = 1;
+			break;
+		case 0x98: // set TDO sample delay (wIndexL), calibrate it if 0xFF
+			// with wValueL bits in the chain. returns the delay set and
+			// the delays that passed calibration as a bit mask
+			if(wIndexL == 0xFF){
+				EP0BUF[0] = CalibrateSampleDelay(wValueL);
+			} else {
+				EP0BUF[0] = ProgIO_SetSampleDelay(wIndexL);
+				EP0BUF[1] = 0;
+			}
+			EP0BCH = 0; // Arm endpoint
+			EP0BCL = (wLengthL<2) ? wLengthL : 2;
+			break;
+		case 0x99: // TDO compare status, clear it afterwards if wIndexL = 1
+			// returns the mismatch flag, the offset of the first failing
+			// byte (32 bit LE) and its failing bits
+			EP0BUF[0] = CompareFail ? 1 : 0;
+			EP0BUF[1] = CompareFailOffset & 0xFF;
+			EP0BUF[2] = (CompareFailOffset >> 8) & 0xFF;
+			EP0BUF[3] = (CompareFailOffset >> 16) & 0xFF;
+			EP0BUF[4] = (CompareFailOffset >> 24) & 0xFF;
+			EP0BUF[5] = CompareFailBits;
+			if(wIndexL & 1) CompareClear();
+			EP0BCH = 0; // Arm endpoint
+			EP0BCL = (wLengthL<6) ? wLengthL : 6;
+			break;
+#ifdef USE_XSVF_PLAYER
+		case 0x9A: // XSVF player: start it (wIndexL = 1) or stop it (2)
+			// returns its status, see the XSVF section
+			if(wIndexL == 1 && XsvfStatus != XSVF_RUNNING) XsvfStart();
+			else if(wIndexL == 2) XsvfStop();
+			EP0BUF[0] = XsvfStatus;
+			EP0BUF[1] = XsvfError;
+			EP0BUF[2] = XsvfCmdOffset & 0xFF;
+			EP0BUF[3] = (XsvfCmdOffset >> 8) & 0xFF;
+			EP0BUF[4] = (XsvfCmdOffset >> 16) & 0xFF;
+			EP0BUF[5] = (XsvfCmdOffset >> 24) & 0xFF;
+			EP0BUF[6] = XsvfOpcode;
+			EP0BUF[7] = XsvfTap;
+			EP0BCH = 0; // Arm endpoint
+			EP0BCL = (wLengthL<8) ? wLengthL : 8;
+			break;
+#endif
+#ifdef PROTOCOL_XPCU
+		case XPCU_REQUEST:
+			XpcuVendorIn();
+			break;
+#endif
 		default: // Dummy data
 			EP0BUF[0] = 0x36;
 			EP0BUF[1] = 0x83;
@@ -28,6 +28,13 @@
 #define SetTDI(x)     do{if(x) IOE|=0x40; else IOE&=~0x40; }while(0)
 #define GetTDO()      ((IOE>>5)&1)
 
+/* The assembly kernels keep an image of IOE in B, with TCK and TDI set
+ * through these bits, and read TDO from IOE through the accumulator */
+
+sbit at 0xF3          IMG_TCK; /* B.3 */
+sbit at 0xF6          IMG_TDI; /* B.6 */
+sbit at 0xE5          ACC_TDO; /* ACC.5 */
+
 /* XPCU has neither AS nor PS mode pins */
 
 #define HAVE_OE_LED 1
@@ -106,17 +113,91 @@ void ProgIO_ShiftOut(unsigned char c)
    * }
    */
 
-  unsigned char lc=c;
+  (void)c; /* argument passed in DPL */
+
+  __asm
+        MOV  A,DPL
+        MOV  B,_IOE
+        ANL  B,#0xB7 ;; TCK and TDI low
+        ;; Bit0
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        ;; Bit1
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        ;; Bit2
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        ;; Bit3
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        ;; Bit4
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        ;; Bit5
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        ;; Bit6
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        ;; Bit7
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+        ret
+  __endasm;
+}
+
+void ProgIO_ShiftTMS(unsigned char tms, unsigned char n)
+{
+  /* Clock out N (1..8) bits from TMS, LSB first, TDI unchanged */
+
+  while(n--)
+  {
+    if(tms&1) IOE|=0x10; else IOE&=~0x10; IOE|=0x08; tms>>=1; IOE&=~0x08;
+  }
+}
 
-  if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc>>=1; IOE&=~0x08;
-  if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc>>=1; IOE&=~0x08;
-  if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc>>=1; IOE&=~0x08;
-  if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc>>=1; IOE&=~0x08;
+void ProgIO_Clock(unsigned long n)
+{
+  /* Run N TCK cycles, TMS and TDI unchanged */
 
-  if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc>>=1; IOE&=~0x08;
-  if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc>>=1; IOE&=~0x08;
-  if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc>>=1; IOE&=~0x08;
-  if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc>>=1; IOE&=~0x08;
+  while(n--)
+  {
+    IOE|=0x08; IOE&=~0x08;
+  }
 }
 
 unsigned char ProgIO_ShiftInOut(unsigned char c)
@@ -133,20 +214,330 @@ unsigned char ProgIO_ShiftInOut(unsigned char c)
    * Return c.
    */
 
-  unsigned char carry;
-  unsigned char lc=c;
+  (void)c; /* argument passed in DPL */
 
-  carry = (IOE&0x20)<<2; if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc=carry|(lc>>1); IOE&=~0x08;
-  carry = (IOE&0x20)<<2; if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc=carry|(lc>>1); IOE&=~0x08;
-  carry = (IOE&0x20)<<2; if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc=carry|(lc>>1); IOE&=~0x08;
-  carry = (IOE&0x20)<<2; if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc=carry|(lc>>1); IOE&=~0x08;
+  __asm
+        MOV  R7,DPL
+        MOV  B,_IOE
+        ANL  B,#0xB7 ;; TCK and TDI low
+        ;; Bit0
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+        ;; Bit1
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+        ;; Bit2
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+        ;; Bit3
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+        ;; Bit4
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+        ;; Bit5
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+        ;; Bit6
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+        ;; Bit7
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
 
-  carry = (IOE&0x20)<<2; if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc=carry|(lc>>1); IOE&=~0x08;
-  carry = (IOE&0x20)<<2; if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc=carry|(lc>>1); IOE&=~0x08;
-  carry = (IOE&0x20)<<2; if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc=carry|(lc>>1); IOE&=~0x08;
-  carry = (IOE&0x20)<<2; if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc=carry|(lc>>1); IOE&=~0x08;
+        MOV  DPL,R7
+        ret
+  __endasm;
 
-  return lc;
+  /* return value in DPL */
+  return c;
 }
 
+void ProgIO_ShiftOut_Block(unsigned char n)
+{
+  /* Shift out N (1..256, 0 means 256) bytes read through XAUTODAT1,
+     each like in ProgIO_ShiftOut */
+
+  (void)n; /* argument passed in DPL */
 
+  __asm
+        MOV  R6,DPL
+        MOV  DPTR,#0xE67B ;; XAUTODAT1
+        MOV  B,_IOE
+        ANL  B,#0xB7 ;; TCK and TDI low
+00001$:
+        MOVX A,@DPTR
+        ;; Bit0
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        ;; Bit1
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        ;; Bit2
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        ;; Bit3
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        ;; Bit4
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        ;; Bit5
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        ;; Bit6
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        ;; Bit7
+        RRC  A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        DJNZ R6,00001$
+        MOV  _IOE,B
+        ret
+  __endasm;
+}
+
+void ProgIO_ShiftInOut_Block(unsigned char n)
+{
+  /* Shift N (1..256, 0 means 256) bytes read through XAUTODAT1, each
+     like in ProgIO_ShiftInOut, and write the results through XAUTODAT2 */
+
+  (void)n; /* argument passed in DPL */
+
+  __asm
+        MOV  R6,DPL
+        MOV  B,_IOE
+        ANL  B,#0xB7 ;; TCK and TDI low
+00001$:
+        MOV  DPTR,#0xE67B ;; XAUTODAT1
+        MOVX A,@DPTR
+        MOV  R7,A
+        ;; Bit0
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+        ;; Bit1
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+        ;; Bit2
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+        ;; Bit3
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+        ;; Bit4
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+        ;; Bit5
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+        ;; Bit6
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+        ;; Bit7
+        MOV  A,_IOE
+        MOV  C,_ACC_TDO
+        MOV  A,R7
+        RRC  A
+        MOV  R7,A
+        MOV  _IMG_TDI,C
+        MOV  _IOE,B
+        SETB _IMG_TCK
+        MOV  _IOE,B
+        CLR  _IMG_TCK
+        MOV  _IOE,B
+
+        MOV  A,R7
+        MOV  DPTR,#0xE67C ;; XAUTODAT2
+        MOVX @DPTR,A
+        DJNZ R6,00001$
+        ret
+  __endasm;
+}
+
+unsigned char ProgIO_SetSpeed(unsigned char s)
+{
+  /* No TCK speed control, the kernels always run at full speed */
+  (void)s;
+  return 0;
+}
+
+unsigned char ProgIO_SetAdaptive(unsigned char on)
+{
+  /* No RTCK input */
+  (void)on;
+  return 0;
+}
+
+unsigned char ProgIO_SetSampleDelay(unsigned char d)
+{
+  /* TDO is always sampled before the rising edge of TCK */
+  (void)d;
+  return 0;
+}
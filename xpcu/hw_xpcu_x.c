@@ -48,38 +48,8 @@ void ProgiO_Deinit(void)  {}
 
 static unsigned char curios;
 
-const unsigned char wavedata[64] =
-{
-  /* Single Write:
-     s0: BITS=D0     NEXT/SGLCRC DATA WAIT 4
-     s1: BITS=       DATA WAIT 4
-     s2: BITS=D1|D0  DATA WAIT 4
-     s3: BITS=D1     DATA WAIT 3
-     s4: BITS=D1     DATA DP IF(RDY0) THEN 5 ELSE 2
-     s5: BITS=D1|D0  DATA WAIT 4
-     s6: BITS=D1     DATA WAIT 3
-     s7: BITS=D1     DATA FIN */
-
-  4, 4, 4, 3, 0x2A, 4, 3, 7,
-  6, 2, 2, 2, 3,    2, 2, 2,
-  1, 0, 3, 2, 2,    3, 2, 2,
-  0, 0, 0, 0, 0,    0, 0, 0x3F,
-
-  /* Single Read:
-     s0: BITS=D0     WAIT 4
-     s1: BITS=       WAIT 4
-     s2: BITS=D1|D0  WAIT 4
-     s3: BITS=D1     WAIT 4
-     s4: BITS=D1|D0  WAIT 3
-     s5: BITS=D1|D0  DP IF(RDY0) THEN 6 ELSE 3
-     s6: BITS=D1     DATA WAIT 4
-     s7: BITS=D1     FIN */
-
-  4, 4, 4, 4, 3, 0x33, 4, 7,
-  0, 0, 0, 0, 0, 1,    2, 0,
-  1, 0, 3, 2, 3, 3,    2, 2,
-  0, 0, 0, 0, 0, 0,    0, 0x3F
-};
+/* wavedata[], generated from hw_xpcu_x.gpf by gpifwave */
+#include "hw_xpcu_x_wave.h"
 
 void ProgIO_Init(void)
 {
@@ -202,6 +172,43 @@ void ProgIO_ShiftOut(unsigned char c)
   curios = locios;
 }
 
+void ProgIO_ShiftTMS(unsigned char tms, unsigned char n)
+{
+  /* Clock out N (1..8) bits from TMS, LSB first, TDI unchanged */
+
+  unsigned char t = curios & ~0x60;
+
+  IOC = 0x81; /* Select direction */
+
+  while(n--)
+  {
+    t &= ~0x20;
+    if(tms & 1) t |= 0x20;
+    SetPins(t);
+    SetPins(t|0x40);
+    tms >>= 1;
+    SetPins(t);
+  };
+
+  curios = t;
+}
+
+void ProgIO_Clock(unsigned long n)
+{
+  /* Run N TCK cycles, TMS and TDI unchanged */
+
+  unsigned char t = curios & ~0x40;
+
+  IOC = 0x81; /* Select direction */
+
+  while(n--)
+  {
+    SetPins(t|0x40);
+    SetPins(t);
+  };
+
+  curios = t;
+}
 
 unsigned char ProgIO_ShiftInOut(unsigned char c)
 {
@@ -228,4 +235,46 @@ unsigned char ProgIO_ShiftInOut(unsigned char c)
   return n;
 }
 
+void ProgIO_ShiftOut_Block(unsigned char n)
+{
+  /* Shift out N (1..256, 0 means 256) bytes read through XAUTODAT1 */
 
+  do
+  {
+    ProgIO_ShiftOut(XAUTODAT1);
+  }
+  while(--n);
+}
+
+void ProgIO_ShiftInOut_Block(unsigned char n)
+{
+  /* Shift N (1..256, 0 means 256) bytes read through XAUTODAT1,
+     write the results through XAUTODAT2 */
+
+  do
+  {
+    XAUTODAT2 = ProgIO_ShiftInOut(XAUTODAT1);
+  }
+  while(--n);
+}
+
+unsigned char ProgIO_SetSpeed(unsigned char s)
+{
+  /* No TCK speed control, the kernels always run at full speed */
+  (void)s;
+  return 0;
+}
+
+unsigned char ProgIO_SetAdaptive(unsigned char on)
+{
+  /* No RTCK input */
+  (void)on;
+  return 0;
+}
+
+unsigned char ProgIO_SetSampleDelay(unsigned char d)
+{
+  /* TDO is always sampled before the rising edge of TCK */
+  (void)d;
+  return 0;
+}